@@ -45,7 +45,7 @@
 # include <stdlib.h> /* calloc, free, malloc */
 #endif
 #ifdef HAVE_STRING_H
-# include <string.h> /* memset, strcmp */
+# include <string.h> /* memmove, memset, strcmp */
 #endif
 #ifdef HAVE_ASSERT_H
 # include <assert.h> /* assert */
@@ -66,6 +66,9 @@
 #include "message.h"
 #include "utf8.h"
 #include "message_view.h"
+#include "hash_table.h"
+#include "message_store.h"
+#include "search_index.h"
 #include "History.h"
 #include "HistoryP.h"
 
@@ -77,6 +80,36 @@
  */
 
 #define offset(field) XtOffsetOf(HistoryRec, field)
+
+/* The line at a display index.  The lines array is a ring starting
+ * at line_base. */
+#define LINE_AT(self, index) \
+    ((self)->history.lines[((self)->history.line_base + (index)) % \
+                           (self)->history.message_capacity])
+
+/* The outstanding copy at an index, counting from the oldest */
+#define COPY_AT(self, index) \
+    ((self)->history.copies[((self)->history.copy_base + (index)) % \
+                            COPY_RING_SIZE])
+
+/* The width of the archived message at an index.  The archive_widths
+ * array is a ring starting at archive_base. */
+#define ARCHIVE_WIDTH(self, index) \
+    ((self)->history.archive_widths[((self)->history.archive_base + \
+                                     (index)) % \
+                                    (self)->history.archive_capacity])
+
+/* The serial number of the archived message at an index, in the same
+ * ring as its width */
+#define ARCHIVE_SERIAL(self, index) \
+    ((self)->history.archive_serials[((self)->history.archive_base + \
+                                      (index)) % \
+                                     (self)->history.archive_capacity])
+
+/* The number of lines displayed, including archived ones */
+#define LINE_COUNT(self) \
+    ((self)->history.archive_count + (self)->history.message_count)
+
 static XtResource resources[] =
 {
     /* XtCallbackProc callback */
@@ -110,6 +143,12 @@ static XtResource resources[] =
         offset(history.code_set), XtRString, (XtPointer)NULL
     },
 
+    /* The name of a scalable font to use instead */
+    {
+        XtNxftFont, XtCString, XtRString, sizeof(char *),
+        offset(history.xft_font), XtRString, (XtPointer)NULL
+    },
+
     /* Pixel timestamp_pixel */
     {
         XtNtimestampPixel, XtCTimestampPixel, XtRPixel, sizeof(Pixel),
@@ -154,11 +193,18 @@ static XtResource resources[] =
 
     /* unsigned int message_capacity */
     {
-        XtNmessageCapacity, XtCMessageCapacity, XtRDimension,
+        XtNmessageCapacity, XtCMessageCapacity, XtRInt,
         sizeof(unsigned int),
         offset(history.message_capacity), XtRImmediate, (XtPointer)32
     },
 
+    /* unsigned int archive_capacity */
+    {
+        XtNarchiveCapacity, XtCArchiveCapacity, XtRInt,
+        sizeof(unsigned int),
+        offset(history.archive_capacity), XtRImmediate, (XtPointer)0
+    },
+
     /* Pixel selection_pixel */
     {
         XtNselectionPixel, XtCSelectionPixel, XtRPixel, sizeof(Pixel),
@@ -174,40 +220,6 @@ static XtResource resources[] =
 #undef offset
 
 
-/* We try to be efficient and use XCopyArea to scroll the history
- * widget, relying on GraphicsExpose events t tell us which parts of
- * the window to repaint afterwards.  Because of the asynchronous
- * nature of this, it's possible that the area described in a
- * GraphicsExpose event will be shifted by an XCopyArea before we have
- * a chance to repaint the damaged region.  To compensate, we record
- * each pending XCopyArea request in a queue and use this information
- * to compensate. */
-struct translation_queue {
-    /* The next item in the queue */
-    translation_queue_t next;
-
-    /* The sequence number of the XCopyArea request */
-    unsigned long request_id;
-
-    /* The X coordinate of the left edge of the XCopyArea request */
-    int left;
-
-    /* The Y coordinate of the left edge of the XCopyArea request */
-    int top;
-
-    /* The X coordinate of the right edge of XCopyArea request */
-    int right;
-
-    /* The Y coordinate of the bottom edge of the XCopyArea request */
-    int bottom;
-
-    /* The displacement in the X direction (positive is to the right) */
-    int dx;
-
-    /* The displacement in the Y direction (positive is down) */
-    int dy;
-};
-
 #if defined(DEBUG_MESSAGE)
 static const char *ref_node = "node";
 static const char *ref_selection = "selection";
@@ -215,36 +227,6 @@ static const char *ref_history = "history";
 static const char *ref_copy = "copy";
 #endif /* DEBUG_MESSAGE */
 
-/* Allocates a translation queue item */
-static translation_queue_t
-translation_queue_alloc(unsigned long request_id,
-                        int src_x,
-                        int src_y,
-                        unsigned int width,
-                        unsigned int height,
-                        int dest_x,
-                        int dest_y)
-{
-    translation_queue_t self;
-
-    /* Allocate memory for the queue item */
-    self = malloc(sizeof(struct translation_queue));
-    if (self == NULL) {
-        return NULL;
-    }
-
-    /* Record the information */
-    self->next = NULL;
-    self->request_id = request_id;
-    self->left = src_x;
-    self->right = src_x + width;
-    self->top = src_y;
-    self->bottom = src_y + height;
-    self->dx = dest_x - src_x;
-    self->dy = dest_y - src_y;
-    return self;
-}
-
 /* We store the history of messages as a tree, according to
  * message-ids and in-reply-to ids */
 struct node {
@@ -256,11 +238,34 @@ struct node {
 
     /* The node's youngest elder sibling */
     node_t sibling;
+
+    /* The node's parent, or NULL if it starts a thread */
+    node_t parent;
+
+    /* The node's eldest child */
+    node_t eldest;
+
+    /* The node's eldest younger sibling */
+    node_t younger;
+
+    /* The number of nodes in this node's subtree, including itself */
+    long size;
+
+    /* The order in which the threads were started, for nodes
+     * without a parent */
+    unsigned long serial;
+
+    /* The serial number of the message in order of receipt */
+    unsigned long message_serial;
+
+    /* The width of the message's view without indentation or
+     * timestamp */
+    long width;
 };
 
 /* Allocates and returns a new node */
 static node_t
-node_alloc(message_t message)
+node_alloc(message_t message, unsigned long message_serial, long width)
 {
     node_t self;
 
@@ -273,8 +278,10 @@ node_alloc(message_t message)
     /* Initialize its fields to sane values */
     memset(self, 0, sizeof(struct node));
 
-    /* Record the message */
+    /* Record the message, its serial number and its width */
     self->message = message;
+    self->message_serial = message_serial;
+    self->width = width;
     MESSAGE_ALLOC_REF(message, ref_node, self);
     return self;
 }
@@ -300,117 +307,205 @@ node_get_id(node_t self)
     return message_get_id(self->message);
 }
 
-/* Add a node to the tree.  WARNING: this is not a friendly function.
- * To avoid having to traverse the tree more than once when adding a
- * node, this function both finds a parent and adds a child to it and
- * also discards any nodes which no longer have visible children.
- *
- * self
- *    The pointer to the root node of the tree.  This will be updated,
- *    so it should really be the official pointer to the tree.
- *
- * parent_id
- *    The Message-Id of the parent of the node to add.
- *
- * child
- *    The child node to be added.  This will be set to NULL, so don't
- *    use a pointer you want to use later.
- *
- * index
- *    The display index of the root node.  This should initially be
- *    one less than the number of visible nodes.  Note that this value
- *    will be overwritten, so don't point to a value you wish to keep.
- *
- * index_out
- *    Will be set to the index of the newly added node.
- *
- * depth
- *    The depth (indentation level) of self.  Should initially be 0.
- *
- * depth_out
- *    Will be set to the depth of the newly added node.
- */
+/* Adds delta to the size of the thread with the given serial number
+ * in the Fenwick tree of thread sizes */
 static void
-node_add1(node_t *self,
-          const char *parent_id,
-          node_t *child,
-          int *index,
-          int *index_out,
-          int depth,
-          int *depth_out)
-{
-    /* Traverse all of our siblings */
-    while (*self != NULL) {
-        const char *id;
-
-        /* If no match yet, then check for one here */
-        if (parent_id && *child != NULL &&
-            (id = node_get_id(*self)) != NULL &&
-            strcmp(id, parent_id) == 0) {
-            /* Match!  Add the child to this node */
-            (*child)->sibling = (*self)->child;
-            (*self)->child = *child;
-            *child = NULL;
-
-            /* Kill the child node it its parent was killed */
-            if (message_is_killed((*self)->message)) {
-                message_set_killed((*self)->child->message, True);
-            }
+threads_add(HistoryWidget self, unsigned long serial, long delta)
+{
+    unsigned int i = (serial & (self->history.thread_slots - 1)) + 1;
 
-            /* Record output information */
-            *index_out = *index;
-            *depth_out = depth + 1;
+    while (i <= self->history.thread_slots) {
+        self->history.thread_sizes[i] += delta;
+        i += i & -i;
+    }
+}
 
-            /* The next node we visit will be the new child.  We don't
-             * want it to update the index to be consistent with the
-             * case where we can't find its parent, so we increment
-             * the index here to compensate for it being decremented
-             * when we traverse the children next. */
-            (*index)++;
+/* Returns the total size of the threads in slots 0 to slot - 1 */
+static long
+threads_prefix(HistoryWidget self, unsigned int slot)
+{
+    long sum = 0;
+
+    while (slot > 0) {
+        sum += self->history.thread_sizes[slot];
+        slot -= slot & -slot;
+    }
+
+    return sum;
+}
+
+/* Returns the number of nodes in the threads older than root.  The
+ * threads occupy consecutive serial numbers, so this is a range sum
+ * which may wrap around the end of the tree. */
+static long
+threads_before(HistoryWidget self, node_t root)
+{
+    unsigned int mask = self->history.thread_slots - 1;
+    unsigned int first = self->history.eldest->serial & mask;
+    unsigned int last = root->serial & mask;
+
+    if (first <= last) {
+        return threads_prefix(self, last) - threads_prefix(self, first);
+    }
+
+    return threads_prefix(self, self->history.thread_slots) -
+        threads_prefix(self, first) + threads_prefix(self, last);
+}
+
+/* Returns the position of a node in a pre-order traversal of the
+ * whole tree, along with its depth */
+static long
+node_position(HistoryWidget self, node_t node, int *depth_out)
+{
+    long position = 0;
+    int depth = 0;
+    node_t sibling;
+
+    /* Count our elder siblings' subtrees and our ancestors */
+    while (node->parent != NULL) {
+        for (sibling = node->sibling;
+             sibling != NULL;
+             sibling = sibling->sibling) {
+            position += sibling->size;
         }
 
-        /* Check with the descendents */
-        if ((*self)->child != NULL) {
-            node_add1(&(*self)->child,
-                      parent_id, child,
-                      index, index_out,
-                      depth + 1, depth_out);
+        node = node->parent;
+        position++;
+        depth++;
+    }
+
+    if (depth_out != NULL) {
+        *depth_out = depth;
+    }
+
+    /* Add the older threads */
+    return position + threads_before(self, node);
+}
+
+/* Makes child the youngest child of parent, or the youngest thread if
+ * parent is NULL */
+static void
+node_link(HistoryWidget self, node_t parent, node_t child)
+{
+    node_t root = child;
+    const char *id;
+
+    child->parent = parent;
+    child->size = 1;
+    child->younger = NULL;
+    if (parent == NULL) {
+        /* Start a new thread */
+        child->sibling = self->history.nodes;
+        if (self->history.nodes != NULL) {
+            self->history.nodes->younger = child;
+        } else {
+            self->history.eldest = child;
         }
 
-        /* We've traversed a node */
-        (*index)--;
+        self->history.nodes = child;
+        child->serial = self->history.thread_serial++;
+    } else {
+        /* Add to the parent's children */
+        child->sibling = parent->child;
+        if (parent->child != NULL) {
+            parent->child->younger = child;
+        } else {
+            parent->eldest = child;
+        }
 
-        /* If this node has scrolled off the top of the history and
-         * has no children then we can safely remove it from the tree.
-         * Note: this check is simplistic, but it will work since the
-         * new node must always be added after any nodes that have
-         * scrolled off the top. */
-        if (*index < 0 && (*self)->child == NULL) {
-            /* If the above statement is true, then it follows that
-             * the node may not have any elder siblings.  Hence this
-             * is a good sanity check. */
-            ASSERT((*self)->sibling == NULL);
-
-            /* Free the node */
-            node_free(*self);
-            *self = NULL;
-            return;
+        parent->child = child;
+
+        /* Grow the subtrees which contain it */
+        for (root = parent; root->parent != NULL; root = root->parent) {
+            root->size++;
         }
 
-        /* The pointer we want to update if this node disappears */
-        self = &(*self)->sibling;
+        root->size++;
+    }
+
+    threads_add(self, root->serial, 1);
+    self->history.node_count++;
+
+    /* Index the node by its message's id */
+    id = node_get_id(child);
+    if (id != NULL && hash_table_put(self->history.ids, id, child) < 0) {
+        DPRINTF((1, "unable to index message %s\n", id));
     }
 }
 
-/* Add a node to the tree.  This is just a friendly wrapper around
- * node_add1() above.
- *
- * self
- *    The pointer to the variable holding the root of the tree.  This
- *    will commonly be modified, so use the actual pointer.
+/* Removes a childless node from the tree and frees it */
+static void
+node_unlink(HistoryWidget self, node_t node)
+{
+    node_t root = node;
+    const char *id;
+
+    /* Sanity check */
+    ASSERT(node->child == NULL);
+
+    /* Remove the node from its siblings */
+    if (node->younger != NULL) {
+        node->younger->sibling = node->sibling;
+    } else if (node->parent != NULL) {
+        node->parent->child = node->sibling;
+    } else {
+        self->history.nodes = node->sibling;
+    }
+
+    if (node->sibling != NULL) {
+        node->sibling->younger = node->younger;
+    } else if (node->parent != NULL) {
+        node->parent->eldest = node->younger;
+    } else {
+        self->history.eldest = node->younger;
+    }
+
+    /* Shrink the subtrees which contained it */
+    while (root->parent != NULL) {
+        root = root->parent;
+        root->size--;
+    }
+
+    threads_add(self, root->serial, -1);
+    self->history.node_count--;
+
+    /* Remove it from the index unless a newer message has the same id */
+    id = node_get_id(node);
+    if (id != NULL && hash_table_get(self->history.ids, id) == node) {
+        hash_table_remove(self->history.ids, id);
+    }
+
+    node_free(node);
+}
+
+/* Discards the nodes which have scrolled off the top of the history
+ * and have no visible descendents.  These are at the start of a
+ * pre-order traversal of the tree, so we only visit the first hidden
+ * nodes. */
+static void
+node_trim(HistoryWidget self, node_t node, long *hidden)
+{
+    node_t younger;
+
+    while (node != NULL && *hidden > 0) {
+        younger = node->younger;
+        (*hidden)--;
+
+        /* Trim the children before deciding whether we're needed */
+        node_trim(self, node->eldest, hidden);
+        if (node->child == NULL) {
+            node_unlink(self, node);
+        }
+
+        node = younger;
+    }
+}
+
+/* Add a node to the tree, discarding any nodes which no longer have
+ * visible children.
  *
  * parent_id
- *    The Message-Id of the parent node; the In-Reply-To field.
+ *    The Message-Id of the parent of the node; the In-Reply-To field.
  *
  * child
  *    The node to be added to the tree.
@@ -426,35 +521,48 @@ node_add1(node_t *self,
  *    Will be set to the depth of the newly added node.
  */
 static void
-node_add(node_t *self,
+node_add(HistoryWidget self,
          const char *parent_id,
          node_t child,
          int count,
          int *index_out,
          int *depth_out)
 {
-    int index;
-
-    /* The last index will be count - 1 */
-    index = count - 1;
+    node_t parent = NULL;
+    long hidden;
 
-    /* Trim the older nodes in the tree, and add the node if its
-     * parent is in the tree. */
-    node_add1(self, parent_id, &child, &index, index_out, 0, depth_out);
+    /* Look up the parent */
+    if (parent_id != NULL) {
+        parent = hash_table_get(self->history.ids, parent_id);
+    }
 
-    /* Add the child now if it didn't get added already */
-    if (child != NULL) {
-        /* Add the node to the tree */
-        child->sibling = *self;
-        (*self) = child;
+    if (parent == NULL) {
+        /* Start a new thread at the bottom */
+        node_link(self, NULL, child);
         *index_out = count - 1;
         *depth_out = 0;
+    } else {
+        /* The child goes after the rest of its parent's subtree */
+        hidden = self->history.node_count + 1 - count;
+        *index_out = node_position(self, parent, depth_out) +
+                     parent->size - hidden;
+        (*depth_out)++;
+        node_link(self, parent, child);
+
+        /* Kill the child node it its parent was killed */
+        if (message_is_killed(parent->message)) {
+            message_set_killed(child->message, True);
+        }
     }
+
+    /* Trim the older nodes in the tree */
+    hidden = self->history.node_count - count;
+    node_trim(self, self->history.eldest, &hidden);
 }
 
-/* Finds the node which wraps message */
-node_t
-node_find(node_t self, message_t message)
+/* Finds the node which wraps message by searching the tree */
+static node_t
+node_find1(node_t self, message_t message)
 {
     node_t result;
 
@@ -467,7 +575,7 @@ node_find(node_t self, message_t message)
 
         /* Is it one of our children? */
         if (self->child) {
-            result = node_find(self->child, message);
+            result = node_find1(self->child, message);
             if (result != NULL) {
                 return result;
             }
@@ -481,6 +589,44 @@ node_find(node_t self, message_t message)
     return NULL;
 }
 
+/* Finds the node which wraps message */
+static node_t
+node_find(HistoryWidget self, message_t message)
+{
+    const char *id = message_get_id(message);
+    node_t node;
+
+    /* Try the index first */
+    if (id != NULL) {
+        node = hash_table_get(self->history.ids, id);
+        if (node != NULL && node->message == message) {
+            return node;
+        }
+    }
+
+    /* Messages without ids and those which share an id with a newer
+     * message aren't in the index */
+    return node_find1(self->history.nodes, message);
+}
+
+/* Returns the index of a node's line in the threaded history, or
+ * (unsigned int)-1 if it has scrolled off the top */
+static unsigned int
+index_of_node(HistoryWidget self, node_t node)
+{
+    long index;
+
+    /* The first node_count - message_count nodes aren't visible */
+    index = node_position(self, node, NULL) -
+        (long)(self->history.node_count - self->history.message_count);
+    if (index < 0 || index >= (long)self->history.message_count) {
+        return (unsigned int)-1;
+    }
+
+    ASSERT(LINE_AT(self, index).message == node->message);
+    return self->history.archive_count + (unsigned int)index;
+}
+
 /* Kills a node and its children */
 void
 node_kill(node_t self)
@@ -532,11 +678,10 @@ node_dump(node_t self, int depth)
 #endif
 
 
-/* Populate an array with message views */
+/* Populate an array with lines */
 static void
 node_populate(node_t self,
-              utf8_renderer_t renderer,
-              message_view_t *array,
+              history_line_t array,
               int depth,
               int *index,
               message_t selection,
@@ -546,7 +691,7 @@ node_populate(node_t self,
     while (self != NULL) {
         /* Add the children first */
         if (self->child) {
-            node_populate(self->child, renderer, array, depth + 1,
+            node_populate(self->child, array, depth + 1,
                           index, selection, selection_index_out);
         }
 
@@ -560,10 +705,12 @@ node_populate(node_t self,
             *selection_index_out = *index;
         }
 
-        /* Wrap the message in a message view */
-        /* FIX THIS: use a real conversion descriptor */
-        array[(*index)--] = message_view_alloc(self->message, depth,
-                                               renderer);
+        /* Record the message's line */
+        array[*index].message = self->message;
+        array[*index].serial = self->message_serial;
+        array[*index].indent = depth;
+        array[*index].width = self->width;
+        (*index)--;
 
         /* Move on to the next node */
         self = self->sibling;
@@ -577,8 +724,8 @@ node_populate(node_t self,
  */
 
 /* Copy one region of the screen to another.  This uses XCopyArea to
- * perform the actual copying, and records information in the
- * translation queue so that GraphicsExpose events can be translated
+ * perform the actual copying, and records information in the ring of
+ * outstanding copies so that GraphicsExpose events can be translated
  * to the new coordinates */
 static void
 copy_area(HistoryWidget self,
@@ -592,62 +739,99 @@ copy_area(HistoryWidget self,
           int dest_x,
           int dest_y)
 {
-    translation_queue_t item;
-
-    /* Allocate a new translation queue item */
-    item = translation_queue_alloc(NextRequest(display), src_x, src_y,
-                                   width, height, dest_x, dest_y);
-    if (item == NULL) {
-        abort();
-    }
-
-    /* Append the item to the translation queue */
-    if (self->history.tqueue_end == NULL) {
-        ASSERT(self->history.tqueue == NULL);
-        self->history.tqueue = item;
-        DPRINTF((5, "first: %lu\n", item->request_id));
+    unsigned long request_id = NextRequest(display);
+    copy_record_t item;
+
+    self->history.copy_total++;
+
+    /* Record the copy if there's room */
+    if (self->history.copy_count < COPY_RING_SIZE) {
+        item = &COPY_AT(self, self->history.copy_count);
+        item->request_id = request_id;
+        item->left = src_x;
+        item->right = src_x + width;
+        item->top = src_y;
+        item->bottom = src_y + height;
+        item->dx = dest_x - src_x;
+        item->dy = dest_y - src_y;
+        self->history.copy_count++;
+        DPRINTF((5, "added: %lu\n", request_id));
     } else {
-        ASSERT(self->history.tqueue != NULL);
-        self->history.tqueue_end->next = item;
-        DPRINTF((5, "added: %lu\n", item->request_id));
+        /* Otherwise fall back to repainting everything */
+        DPRINTF((5, "overflow: %lu\n", request_id));
+        self->history.is_copy_overflow = True;
+        self->history.copy_overflow_id = request_id;
+        self->history.overflow_total++;
     }
 
-    self->history.tqueue_end = item;
-
     /* Make the request */
     XCopyArea(display, window, window, gc, src_x, src_y, width, height,
               dest_x, dest_y);
 }
 
+/* Forgets about the copies which the server had processed by the
+ * time it sent the event with the given sequence number */
+static void
+forget_copies(HistoryWidget self, unsigned long request_id)
+{
+    /* Drop processed copies from the front of the ring */
+    while (self->history.copy_count != 0 &&
+           COPY_AT(self, 0).request_id <= request_id) {
+        DPRINTF((5, "removing item %lu\n", COPY_AT(self, 0).request_id));
+        self->history.copy_base =
+            (self->history.copy_base + 1) % COPY_RING_SIZE;
+        self->history.copy_count--;
+    }
+
+    /* We can track the damage again once the copies which didn't fit
+     * have been processed */
+    if (self->history.is_copy_overflow &&
+        self->history.copy_overflow_id <= request_id) {
+        DPRINTF((5, "overflow cleared\n"));
+        self->history.is_copy_overflow = False;
+    }
+}
+
 /* Translate the bounding box to compensate for unprocessed CopyArea
- * requests */
+ * requests.  If we've lost track of some of them then the bounding box
+ * grows to cover the whole window. */
 static void
 compensate_bbox(HistoryWidget self,
                 unsigned long request_id,
                 XRectangle *bbox)
 {
-    translation_queue_t item;
+    copy_record_t item;
     int left = bbox->x;
     int right = left + bbox->width;
     int top = bbox->y;
     int bottom = top + bbox->height;
+    unsigned int i;
 
     DPRINTF((5, "compensate_bbox() %lu\n", request_id));
 
-    /* Go through each outstanding delta item */
-    item = self->history.tqueue;
-    while (item != NULL) {
-        /* Has the request been processed? */
-        if (item->request_id <= request_id) {
-            DPRINTF((5, "removing item %lu\n", item->request_id));
-
-            /* Yes.  We no longer require it */
-            ASSERT(self->history.tqueue == item);
-            self->history.tqueue = item->next;
-            free(item);
-            item = self->history.tqueue;
-            continue;
-        }
+    /* Forget the copies which have been processed */
+    forget_copies(self, request_id);
+
+    /* Repaint everything if we can't tell where the damage went */
+    if (self->history.is_copy_overflow) {
+        bbox->x = 0;
+        bbox->y = 0;
+        bbox->width = self->core.width;
+        bbox->height = self->core.height;
+        self->history.full_redraw_total++;
+        return;
+    }
+
+    /* Bail if there's nothing to compensate for */
+    if (self->history.copy_count == 0) {
+        return;
+    }
+
+    self->history.compensate_total++;
+
+    /* Go through each outstanding copy */
+    for (i = 0; i < self->history.copy_count; i++) {
+        item = &COPY_AT(self, i);
 
         DPRINTF((5, "compensating for item %lu; %ux%u+%d+%d to %d,%d\n",
                  item->request_id,
@@ -696,14 +880,6 @@ compensate_bbox(HistoryWidget self,
         } else {
             /* nothing */
         }
-
-        item = item->next;
-    }
-
-    /* Tidy up if the queue is empty */
-    if (self->history.tqueue == NULL) {
-        DPRINTF((5, "empty!\n"));
-        self->history.tqueue_end = NULL;
     }
 
     /* Update the bbox */
@@ -809,10 +985,21 @@ init(Widget request, Widget widget, ArgList args, Cardinal *num_args)
     /* No GC to start with */
     self->history.gc = None;
 
-    /* Allocate a conversion descriptor */
-    self->history.renderer = utf8_renderer_alloc(XtDisplay(widget),
-                                                 self->history.font,
-                                                 self->history.code_set);
+    /* Use the scalable font if one was named and it can be opened */
+    self->history.renderer = NULL;
+    if (self->history.xft_font != NULL) {
+        self->history.renderer = utf8_renderer_alloc_xft(
+            XtDisplay(widget), XtScreen(widget), self->core.colormap,
+            self->history.xft_font);
+    }
+
+    /* Otherwise allocate a conversion descriptor */
+    if (self->history.renderer == NULL) {
+        self->history.renderer = utf8_renderer_alloc(XtDisplay(widget),
+                                                     self->history.font,
+                                                     self->history.code_set);
+    }
+
     if (self->history.renderer == NULL) {
         perror("trouble");
         exit(1);
@@ -827,8 +1014,9 @@ init(Widget request, Widget widget, ArgList args, Cardinal *num_args)
     self->history.height = (long)self->history.margin_height * 2;
 
     /* Compute the line height */
-    self->history.line_height = (long)self->history.font->ascent +
-        (long)self->history.font->descent + 1;
+    self->history.line_height =
+        (long)utf8_renderer_ascent(self->history.renderer) +
+        (long)utf8_renderer_descent(self->history.renderer) + 1;
 
     /* Initialize the x and y coordinates of the visible region */
     self->history.x = 0;
@@ -836,24 +1024,103 @@ init(Widget request, Widget widget, ArgList args, Cardinal *num_args)
     self->history.pointer_x = 0;
     self->history.pointer_y = 0;
 
-    /* Start with an empty delta queue */
-    self->history.tqueue = NULL;
-    self->history.tqueue_end = NULL;
+    /* Start with no outstanding copies */
+    self->history.copy_base = 0;
+    self->history.copy_count = 0;
+    self->history.is_copy_overflow = False;
+    self->history.copy_overflow_id = 0;
+    self->history.copy_total = 0;
+    self->history.compensate_total = 0;
+    self->history.overflow_total = 0;
+    self->history.full_redraw_total = 0;
 
     /* Assume we're threaded */
     self->history.is_threaded = True;
 
     /* We don't have any nodes yet */
     self->history.nodes = NULL;
+    self->history.eldest = NULL;
+    self->history.node_count = 0;
+    self->history.ids = hash_table_alloc();
+    if (self->history.ids == NULL) {
+        perror("trouble");
+        exit(1);
+    }
+
+    /* Allocate enough room for all of our lines.  The capacities are
+     * converted as ints, so treat negative values as zero. */
+    if ((int)self->history.message_capacity < 1) {
+        self->history.message_capacity = 1;
+    }
+
+    if ((int)self->history.archive_capacity < 0) {
+        self->history.archive_capacity = 0;
+    }
 
-    /* Allocate enough room for all of our message views */
-    self->history.message_capacity = MAX(self->history.message_capacity, 1);
     self->history.messages = calloc(self->history.message_capacity,
                                     sizeof(message_t));
+    self->history.message_widths = calloc(self->history.message_capacity,
+                                          sizeof(long));
     self->history.message_count = 0;
     self->history.message_index = 0;
-    self->history.message_views = calloc(self->history.message_capacity,
-                                         sizeof(message_view_t));
+    self->history.message_serial = 0;
+    self->history.search_serial = 0;
+    self->history.search_index = search_index_alloc();
+    if (self->history.search_index == NULL) {
+        perror("trouble");
+        exit(1);
+    }
+
+    self->history.lines = calloc(self->history.message_capacity,
+                                 sizeof(struct history_line));
+    self->history.line_base = 0;
+
+    /* Message views are only created for lines as they're painted */
+    memset(self->history.view_cache, 0, sizeof(self->history.view_cache));
+    self->history.view_clock = 0;
+    self->history.indent_width =
+        message_view_indent_width(self->history.renderer);
+    self->history.timestamp_width =
+        message_view_timestamp_width(self->history.renderer);
+
+    /* Keep old messages in a compact archive if asked to */
+    self->history.archive = NULL;
+    self->history.archive_widths = NULL;
+    self->history.archive_serials = NULL;
+    self->history.archive_base = 0;
+    self->history.archive_count = 0;
+    self->history.archive_serial = 0;
+    if (self->history.archive_capacity != 0) {
+        self->history.archive =
+            message_store_alloc(self->history.archive_capacity);
+        self->history.archive_widths =
+            calloc(self->history.archive_capacity, sizeof(long));
+        self->history.archive_serials =
+            calloc(self->history.archive_capacity, sizeof(unsigned long));
+        if (self->history.archive == NULL ||
+            self->history.archive_widths == NULL ||
+            self->history.archive_serials == NULL) {
+            perror("trouble");
+            exit(1);
+        }
+    }
+
+    /* There can't be more distinct widths than lines */
+    self->history.widths = calloc(self->history.message_capacity +
+                                  self->history.archive_capacity,
+                                  sizeof(struct width_count));
+    self->history.width_count = 0;
+
+    /* At most one thread can be entirely hidden, and we briefly have
+     * one more while adding a node */
+    self->history.thread_slots = 1;
+    while (self->history.thread_slots < self->history.message_capacity + 2) {
+        self->history.thread_slots *= 2;
+    }
+
+    self->history.thread_sizes = calloc(self->history.thread_slots + 1,
+                                        sizeof(long));
+    self->history.thread_serial = 0;
 
     /* Nothing is selected yet */
     self->history.selection = NULL;
@@ -1065,7 +1332,132 @@ paint_highlight(HistoryWidget self)
     XDrawSegments(display, window, gc, segments, i);
 }
 
-/* Repaint the widget */
+/* Returns a message view from the view cache, creating one if it
+ * isn't there already.  Archived messages are identified by their
+ * serial number and a NULL message.  The view belongs to the cache and
+ * may be freed by the next call.  Returns NULL if no view could be
+ * created. */
+static message_view_t
+cached_view(HistoryWidget self,
+            message_t message,
+            long indent,
+            unsigned long serial)
+{
+    view_cache_entry_t entry;
+    view_cache_entry_t victim;
+    message_t archived;
+    unsigned int i;
+
+    /* Look for the view, noting the least recently used entry in case
+     * we need to replace it */
+    victim = self->history.view_cache;
+    for (i = 0; i < VIEW_CACHE_SIZE; i++) {
+        entry = self->history.view_cache + i;
+        if (entry->view != NULL &&
+            entry->message == message &&
+            entry->indent == indent &&
+            entry->serial == serial) {
+            entry->used = ++self->history.view_clock;
+            return entry->view;
+        }
+
+        if (victim->view != NULL &&
+            (entry->view == NULL || entry->used < victim->used)) {
+            victim = entry;
+        }
+    }
+
+    /* Make room for a new view */
+    entry = victim;
+    if (entry->view != NULL) {
+        message_view_free(entry->view);
+        entry->view = NULL;
+    }
+
+    /* Create it */
+    /* FIX THIS: use a real conversion descriptor */
+    if (message != NULL) {
+        entry->view = message_view_alloc(message, indent,
+                                         self->history.renderer);
+    } else {
+        /* Rebuild the archived message for the view to hold onto */
+        archived = message_store_get(
+            self->history.archive,
+            (unsigned int)(serial - (self->history.archive_serial -
+                                     self->history.archive_count)));
+        if (archived == NULL) {
+            return NULL;
+        }
+
+        MESSAGE_ALLOC_REF(archived, ref_history, self);
+        entry->view = message_view_alloc(archived, 0,
+                                         self->history.renderer);
+        MESSAGE_FREE_REF(archived, ref_history, self);
+    }
+
+    if (entry->view == NULL) {
+        return NULL;
+    }
+
+    entry->message = message;
+    entry->indent = indent;
+    entry->serial = serial;
+    entry->used = ++self->history.view_clock;
+    return entry->view;
+}
+
+/* Returns a message view for the line displayed at index, or NULL if
+ * none could be created */
+static message_view_t
+row_view(HistoryWidget self, unsigned int index)
+{
+    history_line_t line;
+
+    /* Archived messages are displayed first */
+    if (index < self->history.archive_count) {
+        return cached_view(self, NULL, 0,
+                           self->history.archive_serial -
+                           self->history.archive_count + index);
+    }
+
+    line = &LINE_AT(self, index - self->history.archive_count);
+    return cached_view(self, line->message, line->indent, 0);
+}
+
+/* Returns the message displayed at index, or NULL if an archived
+ * message couldn't be rebuilt */
+static message_t
+row_message(HistoryWidget self, unsigned int index)
+{
+    message_view_t view;
+
+    if (index < self->history.archive_count) {
+        view = row_view(self, index);
+        return view == NULL ? NULL : message_view_get_message(view);
+    }
+
+    return LINE_AT(self, index - self->history.archive_count).message;
+}
+
+/* Frees all of the message views in the view cache */
+static void
+view_cache_flush(HistoryWidget self)
+{
+    view_cache_entry_t entry;
+    unsigned int i;
+
+    for (i = 0; i < VIEW_CACHE_SIZE; i++) {
+        entry = self->history.view_cache + i;
+        if (entry->view != NULL) {
+            message_view_free(entry->view);
+            entry->view = NULL;
+        }
+    }
+}
+
+/* Repaint the widget.  Visible lines are collected in batches and
+ * painted one color at a time across each batch so that the GC only
+ * changes a handful of times per repaint. */
 static void
 paint(HistoryWidget self, XRectangle *bbox)
 {
@@ -1075,10 +1467,16 @@ paint(HistoryWidget self, XRectangle *bbox)
     long xmargin = (long)self->history.margin_width;
     long ymargin = (long)self->history.margin_height;
     int show_timestamps = self->history.show_timestamps;
+    message_view_t views[PAINT_BATCH_SIZE];
+    unsigned long pixels[MESSAGE_VIEW_PIXEL_COUNT];
     message_view_t view;
     XGCValues values;
     unsigned int index;
-    long x, y;
+    Boolean is_selected;
+    Boolean is_done;
+    int pixel_count;
+    int count, i, j;
+    long x, y, top;
 
     /* Set that as our bounding box */
     XSetClipRectangles(display, gc, 0, 0, bbox, 1, YXSorted);
@@ -1098,42 +1496,80 @@ paint(HistoryWidget self, XRectangle *bbox)
         y = (ymargin - self->history.y) % self->history.line_height;
     }
 
-    /* Draw all visible message views */
-    while (index < self->history.message_count) {
-        /* Stop if we run out of message views. */
-        view = self->history.message_views[index++];
-        if (view == NULL) {
-            return;
-        }
+    /* Find out which colors we'll be painting */
+    pixel_count = message_view_pixels(
+        show_timestamps, self->history.timestamp_pixel,
+        self->history.group_pixel, self->history.user_pixel,
+        self->history.string_pixel, self->history.separator_pixel,
+        pixels);
+
+    /* Draw all visible lines */
+    is_done = False;
+    while (!is_done && index < LINE_COUNT(self)) {
+        /* Collect the next batch of views */
+        top = y;
+        count = 0;
+        while (count < PAINT_BATCH_SIZE && index < LINE_COUNT(self)) {
+            /* Stop if we can't get a message view for the line.
+             * Archived messages are rebuilt for their views, so
+             * recognize the selection among them by its index. */
+            view = row_view(self, index);
+            if (index < self->history.archive_count) {
+                is_selected = index == self->history.selection_index;
+            } else {
+                is_selected = LINE_AT(
+                    self, index - self->history.archive_count).message ==
+                    self->history.selection;
+            }
 
-        /* Is this the selected message? */
-        if (message_view_get_message(view) == self->history.selection) {
-            /* Yes, draw a background for it */
-            values.foreground = self->history.selection_pixel;
-            XChangeGC(display, gc, GCForeground, &values);
+            index++;
+            if (view == NULL) {
+                is_done = True;
+                break;
+            }
 
-            /* FIX THIS: should we respect the margin? */
-            XFillRectangle(display, window, gc, 0, y,
-                           self->core.width, self->history.line_height);
+            /* Is this the selected message? */
+            if (is_selected) {
+                /* Yes, draw a background for it */
+                values.foreground = self->history.selection_pixel;
+                XChangeGC(display, gc, GCForeground, &values);
 
-            /* Draw the highlight */
-            paint_highlight(self);
-        }
+                /* FIX THIS: should we respect the margin? */
+                XFillRectangle(display, window, gc, 0, y,
+                               self->core.width, self->history.line_height);
 
-        /* Draw the view */
-        message_view_paint(
-            view, display, window, gc,
-            show_timestamps, self->history.timestamp_pixel,
-            self->history.group_pixel, self->history.user_pixel,
-            self->history.string_pixel, self->history.separator_pixel,
-            x, y + self->history.font->ascent, bbox);
+                /* Draw the highlight */
+                paint_highlight(self);
+            }
 
-        /* Get ready to draw the next one */
-        y += self->history.line_height;
+            views[count++] = view;
 
-        /* Bail out if the next line is past the end of the screen */
-        if (y >= self->core.height) {
-            return;
+            /* Get ready to draw the next one */
+            y += self->history.line_height;
+
+            /* Bail out if the next line is past the end of the screen */
+            if (y >= self->core.height) {
+                is_done = True;
+                break;
+            }
+        }
+
+        /* Paint the batch one color at a time */
+        for (i = 0; i < pixel_count; i++) {
+            values.foreground = pixels[i];
+            XChangeGC(display, gc, GCForeground, &values);
+
+            for (j = 0; j < count; j++) {
+                message_view_paint_pixel(
+                    views[j], display, window, gc,
+                    show_timestamps, pixels[i],
+                    self->history.timestamp_pixel,
+                    self->history.group_pixel, self->history.user_pixel,
+                    self->history.string_pixel,
+                    self->history.separator_pixel,
+                    x, top + j * self->history.line_height +
+                    utf8_renderer_ascent(self->history.renderer), bbox);
+            }
         }
     }
 }
@@ -1175,7 +1611,7 @@ redisplay_index(HistoryWidget self, unsigned int index)
     long y;
 
     /* Bail if the index is out of range */
-    if (index >= self->history.message_count) {
+    if (index >= LINE_COUNT(self)) {
         return;
     }
 
@@ -1201,28 +1637,27 @@ motion_cb(Widget widget, XtPointer closure, XEvent *event,
     HistoryWidget self = (HistoryWidget)widget;
     XMotionEvent *mevent;
     unsigned int index;
-    message_view_t view;
+    message_t message;
 
     /* Sanity check */
     ASSERT(event->type == MotionNotify);
     mevent = (XMotionEvent *)event;
 
     /* Assume that nothing is under the pointer */
-    view = NULL;
+    message = NULL;
 
     /* Make sure the pointer is within the bounds of the widget */
     if (0 <= mevent->y && mevent->y < self->core.height) {
         index = index_of_y(self, mevent->y);
 
         /* Make sure it's over a message */
-        if (index < self->history.message_count) {
-            view = self->history.message_views[index];
+        if (index < LINE_COUNT(self)) {
+            message = row_message(self, index);
         }
     }
 
     /* Call the callbacks */
-    XtCallCallbackList(widget, self->history.motion_callbacks,
-                       view ? message_view_get_message(view) : NULL);
+    XtCallCallbackList(widget, self->history.motion_callbacks, message);
 }
 
 /* Repaint the bits of the widget that didn't get copied */
@@ -1276,8 +1711,10 @@ process_events(Widget widget, XtPointer closure, XEvent *event,
             break;
 
         case NoExpose:
-            /* Stop drawing if the widget is obscured. */
+            /* Stop drawing if the widget is obscured.  The copies
+             * before this one needed no repainting. */
             DPRINTF((5, "History: NoExpose event\n"));
+            forget_copies(self, event->xnoexpose.serial);
             *continue_to_dispatch = False;
             return;
 
@@ -1291,51 +1728,155 @@ process_events(Widget widget, XtPointer closure, XEvent *event,
             *continue_to_dispatch = True;
             return;
 
-        case SelectionNotify:
-            DPRINTF((5, "History: electionNotify\n"));
-            *continue_to_dispatch = True;
-            return;
+        case SelectionNotify:
+            DPRINTF((5, "History: electionNotify\n"));
+            *continue_to_dispatch = True;
+            return;
+
+        case ClientMessage:
+        case MappingNotify:
+            *continue_to_dispatch = True;
+            return;
+
+        default:
+            DPRINTF((5, "ignoring unknown event type: %d\n", event->type));
+            *continue_to_dispatch = True;
+            return;
+        }
+
+        /* Otherwise grab the next event */
+        XNextEvent(display, &event_buffer);
+        event = &event_buffer;
+    }
+}
+
+/* Returns the index of the first entry in the width histogram which
+ * is at least as wide as width */
+static unsigned int
+widths_find(HistoryWidget self, long width)
+{
+    unsigned int low = 0;
+    unsigned int high = self->history.width_count;
+    unsigned int middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (self->history.widths[middle].width < width) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/* Returns the width of a line as it is currently displayed */
+static long
+line_width(HistoryWidget self, history_line_t line)
+{
+    long width;
+
+    width = line->width + line->indent * self->history.indent_width;
+    if (self->history.show_timestamps) {
+        width += self->history.timestamp_width;
+    }
+
+    return width;
+}
+
+/* Records the width of a line in the histogram */
+static void
+widths_add(HistoryWidget self, history_line_t line)
+{
+    width_count_t entry;
+    unsigned int index;
+    long width;
+
+    width = line_width(self, line);
+    index = widths_find(self, width);
+    entry = self->history.widths + index;
+
+    /* Count another line of a width we've already seen */
+    if (index < self->history.width_count && entry->width == width) {
+        entry->count++;
+        return;
+    }
+
+    /* Otherwise make room for a new width */
+    ASSERT(self->history.width_count <
+           self->history.message_capacity + self->history.archive_capacity);
+    memmove(entry + 1, entry,
+            (self->history.width_count - index) * sizeof(struct width_count));
+    entry->width = width;
+    entry->count = 1;
+    self->history.width_count++;
+}
 
-        case ClientMessage:
-        case MappingNotify:
-            *continue_to_dispatch = True;
-            return;
+/* Removes the width of a line from the histogram */
+static void
+widths_remove(HistoryWidget self, history_line_t line)
+{
+    width_count_t entry;
+    unsigned int index;
+    long width;
 
-        default:
-            DPRINTF((5, "ignoring unknown event type: %d\n", event->type));
-            *continue_to_dispatch = True;
-            return;
-        }
+    width = line_width(self, line);
+    index = widths_find(self, width);
+    entry = self->history.widths + index;
 
-        /* Otherwise grab the next event */
-        XNextEvent(display, &event_buffer);
-        event = &event_buffer;
+    /* Sanity check */
+    ASSERT(index < self->history.width_count);
+    ASSERT(entry->width == width);
+
+    /* Forget the width once the last line of it is gone */
+    if (--entry->count == 0) {
+        self->history.width_count--;
+        memmove(entry, entry + 1,
+                (self->history.width_count - index) *
+                sizeof(struct width_count));
+    }
+}
+
+/* Returns the width of the widest line */
+static long
+widths_max(HistoryWidget self)
+{
+    if (self->history.width_count == 0) {
+        return 0;
     }
+
+    return self->history.widths[self->history.width_count - 1].width;
 }
 
 /* Recompute the dimensions of the widget and update the scrollbars */
 static void
 recompute_dimensions(HistoryWidget self)
 {
-    int show_timestamps = self->history.show_timestamps;
-    long width = 0;
-    long height = 0;
+    struct history_line archived;
+    long height;
     unsigned int i;
     long x, y;
 
-    /* Measure each message */
-    for (i = 0; i < self->history.message_count; i++) {
-        struct string_sizes sizes;
+    /* Measure each archived line */
+    self->history.width_count = 0;
+    archived.message = NULL;
+    archived.indent = 0;
+    for (i = 0; i < self->history.archive_count; i++) {
+        archived.width = ARCHIVE_WIDTH(self, i);
+        widths_add(self, &archived);
+    }
 
-        message_view_get_sizes(self->history.message_views[i],
-                               show_timestamps,
-                               &sizes);
-        width = MAX(width, sizes.width);
-        height += self->history.line_height;
+    /* And each of the others */
+    for (i = 0; i < self->history.message_count; i++) {
+        widths_add(self, &LINE_AT(self, i));
     }
 
+    height = (long)LINE_COUNT(self) * self->history.line_height;
+
     /* Update our dimensions */
-    self->history.width = width + (long)self->history.margin_width * 2;
+    self->history.width = widths_max(self) +
+                          (long)self->history.margin_width * 2;
     self->history.height = height + (long)self->history.margin_height * 2;
 
     /* And update the scrollbars */
@@ -1372,26 +1913,349 @@ realize(Widget widget,
     XtAddEventHandler(widget, PointerMotionMask, False, motion_cb, NULL);
 }
 
-/* Insert a message before the given index */
+/* Inserts a line into the ring before the given index, moving
+ * whichever side of the ring is shorter */
+static void
+lines_insert(HistoryWidget self, unsigned int index, history_line_t line)
+{
+    unsigned int count = self->history.message_count;
+    unsigned int i;
+
+    /* Sanity check */
+    ASSERT(count < self->history.message_capacity);
+    ASSERT(index <= count);
+
+    if (index < count - index) {
+        /* Move the start of the ring back and the lines before the
+         * index along with it */
+        self->history.line_base =
+            (self->history.line_base + self->history.message_capacity - 1) %
+            self->history.message_capacity;
+        for (i = 0; i < index; i++) {
+            LINE_AT(self, i) = LINE_AT(self, i + 1);
+        }
+    } else {
+        /* Move the lines after the index down */
+        for (i = count; i > index; i--) {
+            LINE_AT(self, i) = LINE_AT(self, i - 1);
+        }
+    }
+
+    LINE_AT(self, index) = *line;
+    self->history.message_count++;
+
+    /* Either way the selection moves down if it was after the index */
+    if (self->history.selection_index != (unsigned int)-1 &&
+        self->history.selection_index >=
+        self->history.archive_count + index) {
+        self->history.selection_index++;
+    }
+}
+
+/* Removes the first line from the ring to make room for another,
+ * moving its message into the archive if there is one.  This must be
+ * done while the line's message is still in the history.  Returns
+ * True if a line disappeared from the top of the widget as a result,
+ * False if the line is still displayed as an archived one. */
+static Boolean
+discard_line(HistoryWidget self)
+{
+    history_line_t line = &LINE_AT(self, 0);
+    struct history_line archived;
+    Boolean is_dropped = True;
+
+    /* Sanity check */
+    ASSERT(self->history.message_count != 0);
+
+    /* Forget the line's width */
+    widths_remove(self, line);
+
+    /* Try to archive its message */
+    archived.message = NULL;
+    archived.indent = 0;
+    if (self->history.archive != NULL &&
+        message_store_add(self->history.archive, line->message) == 0) {
+        if (self->history.archive_count == self->history.archive_capacity) {
+            /* The archive discarded its oldest message to make room */
+            archived.width = ARCHIVE_WIDTH(self, 0);
+            widths_remove(self, &archived);
+            self->history.archive_base = (self->history.archive_base + 1) %
+                self->history.archive_capacity;
+            self->history.archive_count--;
+        } else {
+            is_dropped = False;
+        }
+
+        archived.width = line->width;
+        ARCHIVE_WIDTH(self, self->history.archive_count) = archived.width;
+        ARCHIVE_SERIAL(self, self->history.archive_count) = line->serial;
+        self->history.archive_count++;
+        self->history.archive_serial++;
+        widths_add(self, &archived);
+    }
+
+    /* Advance the start of the ring */
+    self->history.line_base = (self->history.line_base + 1) %
+        self->history.message_capacity;
+    self->history.message_count--;
+
+    /* Everything moves up if the top line has gone */
+    if (is_dropped) {
+        if (self->history.selection_index == 0) {
+            self->history.selection_index = (unsigned int)-1;
+        } else if (self->history.selection_index != (unsigned int)-1) {
+            self->history.selection_index--;
+        }
+    }
+
+    return is_dropped;
+}
+
+/* A message which may belong in a rebuilt archive */
+struct archive_entry {
+    /* The message's serial number in order of receipt */
+    unsigned long serial;
+
+    /* The width of its view, without indentation or timestamp */
+    long width;
+
+    /* The message if it was on a line, or NULL if it was archived */
+    message_t message;
+
+    /* Its index in the archive if it was archived */
+    unsigned int index;
+};
+
+/* Orders serial numbers for qsort() and bsearch() */
+static int
+serial_compare(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *)a;
+    unsigned long y = *(const unsigned long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Orders archive entries by serial number for qsort() */
+static int
+archive_entry_compare(const void *a, const void *b)
+{
+    return serial_compare(&((const struct archive_entry *)a)->serial,
+                          &((const struct archive_entry *)b)->serial);
+}
+
+/* Returns an entry for every archived message and every line so that
+ * the archive can be rebuilt once the lines have been laid out again,
+ * and sets count_out to their number.  Returns NULL if there's no
+ * archive or no memory for the entries. */
+static struct archive_entry *
+archive_entries(HistoryWidget self, unsigned int *count_out)
+{
+    struct archive_entry *entries;
+    struct archive_entry *entry;
+    history_line_t line;
+    unsigned int i;
+
+    if (self->history.archive == NULL) {
+        return NULL;
+    }
+
+    entries = malloc((LINE_COUNT(self) + 1) * sizeof(struct archive_entry));
+    if (entries == NULL) {
+        return NULL;
+    }
+
+    entry = entries;
+    for (i = 0; i < self->history.archive_count; i++) {
+        entry->serial = ARCHIVE_SERIAL(self, i);
+        entry->width = ARCHIVE_WIDTH(self, i);
+        entry->message = NULL;
+        entry->index = i;
+        entry++;
+    }
+
+    /* The lines' messages are kept alive by the tree and the messages
+     * array, neither of which changes while the lines are laid out */
+    for (i = 0; i < self->history.message_count; i++) {
+        line = &LINE_AT(self, i);
+        entry->serial = line->serial;
+        entry->width = line->width;
+        entry->message = line->message;
+        entry->index = 0;
+        entry++;
+    }
+
+    *count_out = LINE_COUNT(self);
+    return entries;
+}
+
+/* Rebuilds the archive in order of receipt from those of the entries
+ * which aren't on a line, keeping the newest if they don't all fit.
+ * Threaded and unthreaded lines hold different messages, so this
+ * keeps each message on exactly one row when the threading changes.
+ * Returns 0 on success, or -1 if the old archive had to be kept. */
+static int
+archive_rebuild(HistoryWidget self,
+                struct archive_entry *entries,
+                unsigned int count)
+{
+    unsigned int line_count = self->history.message_count;
+    message_store_t archive;
+    unsigned long *serials;
+    message_t message;
+    unsigned int first;
+    unsigned int i, n;
+
+    /* Allocate the new archive and something to sort the lines'
+     * serial numbers in */
+    archive = message_store_alloc(self->history.archive_capacity);
+    serials = malloc((line_count + 1) * sizeof(unsigned long));
+    if (archive == NULL || serials == NULL) {
+        if (archive != NULL) {
+            message_store_free(archive);
+        }
+
+        free(serials);
+        return -1;
+    }
+
+    for (i = 0; i < line_count; i++) {
+        serials[i] = LINE_AT(self, i).serial;
+    }
+
+    qsort(serials, line_count, sizeof(unsigned long), serial_compare);
+
+    /* Leave out the messages which are on a line */
+    n = 0;
+    for (i = 0; i < count; i++) {
+        if (bsearch(&entries[i].serial, serials, line_count,
+                    sizeof(unsigned long), serial_compare) == NULL) {
+            entries[n++] = entries[i];
+        }
+    }
+
+    free(serials);
+
+    /* Put the rest in order of receipt and keep the newest */
+    qsort(entries, n, sizeof(struct archive_entry), archive_entry_compare);
+    first = n > self->history.archive_capacity ?
+        n - self->history.archive_capacity : 0;
+
+    /* Copy them into the new archive */
+    self->history.archive_base = 0;
+    self->history.archive_count = 0;
+    for (i = first; i < n; i++) {
+        message = entries[i].message;
+        if (message == NULL) {
+            message = message_store_get(self->history.archive,
+                                        entries[i].index);
+            if (message == NULL) {
+                continue;
+            }
+        }
+
+        MESSAGE_ALLOC_REF(message, ref_history, self);
+        if (message_store_add(archive, message) == 0) {
+            ARCHIVE_WIDTH(self, self->history.archive_count) =
+                entries[i].width;
+            ARCHIVE_SERIAL(self, self->history.archive_count) =
+                entries[i].serial;
+            self->history.archive_count++;
+        }
+
+        MESSAGE_FREE_REF(message, ref_history, self);
+    }
+
+    message_store_free(self->history.archive);
+    self->history.archive = archive;
+
+    /* Number the archived messages afresh so that no cached view is
+     * mistaken for one of them */
+    view_cache_flush(self);
+    self->history.archive_serial += self->history.archive_count;
+    return 0;
+}
+
+/* Returns the index of the row which displays the message with the
+ * given serial number, or (unsigned int)-1 if none does.  The archive
+ * must be in order of receipt. */
+static unsigned int
+index_of_serial(HistoryWidget self, unsigned long serial)
+{
+    unsigned int low, high, middle;
+    unsigned int i;
+
+    for (i = 0; i < self->history.message_count; i++) {
+        if (LINE_AT(self, i).serial == serial) {
+            return self->history.archive_count + i;
+        }
+    }
+
+    low = 0;
+    high = self->history.archive_count;
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (ARCHIVE_SERIAL(self, middle) < serial) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < self->history.archive_count &&
+        ARCHIVE_SERIAL(self, low) == serial) {
+        return low;
+    }
+
+    return (unsigned int)-1;
+}
+
+/* Adds the words of a message to the search index */
+static void
+search_add(HistoryWidget self, unsigned long serial, message_t message)
+{
+    search_index_t index = self->history.search_index;
+
+    search_index_add(index, serial, message_get_group(message));
+    search_index_add(index, serial, message_get_user(message));
+    search_index_add(index, serial, message_get_string(message));
+}
+
+/* Removes the words of the oldest message from the search index */
+static void
+search_remove(HistoryWidget self, unsigned long serial, message_t message)
+{
+    search_index_t index = self->history.search_index;
+
+    search_index_remove(index, serial, message_get_group(message));
+    search_index_remove(index, serial, message_get_user(message));
+    search_index_remove(index, serial, message_get_string(message));
+}
+
+/* Insert a message with the given serial number before the given
+ * index.  If is_dropped is True then discard_line() has just removed
+ * a line from the top of the widget to make room for it. */
 static void
 insert_message(HistoryWidget self,
                unsigned int index,
                unsigned int indent,
-               message_t message)
+               message_t message,
+               unsigned long serial,
+               long message_width,
+               Boolean is_dropped)
 {
     Display *display = XtDisplay((Widget)self);
     Window window = XtWindow((Widget)self);
+    struct history_line line;
     message_view_t view;
-    struct string_sizes sizes;
-    long y = 0;
+    long y = (long)(self->history.archive_count + index) *
+        self->history.line_height;
     long delta_y;
-    long width = 0;
-    long height = 0;
+    long width;
+    long height;
     XRectangle bbox;
-    unsigned int i;
     XGCValues values;
     GC gc = self->history.gc;
-    int show_timestamps = self->history.show_timestamps;
     long xpos, ypos;
 
     /* Sanity check */
@@ -1404,36 +2268,10 @@ insert_message(HistoryWidget self,
         XChangeGC(display, gc, GCClipMask | GCForeground, &values);
     }
 
-    /* If there's still room then we'll have to move stuff down */
-    if (self->history.message_count < self->history.message_capacity) {
-        /* Measure the nodes before the index */
-        for (i = 0; i < index; i++) {
-            view = self->history.message_views[i];
-
-            /* Measure the view */
-            message_view_get_sizes(view, show_timestamps, &sizes);
-            width = MAX(width, sizes.width);
-            y += self->history.line_height;
-            height += self->history.line_height;
-        }
-
-        /* Measure the nodes after the index, moving them down to make
-         * room for the new message. */
-        for (i = self->history.message_count; i > index; i--) {
-            view = self->history.message_views[i - 1];
-
-            /* Measure the view */
-            message_view_get_sizes(view, show_timestamps, &sizes);
-            width = MAX(width, sizes.width);
-            height += self->history.line_height;
-
-            /* Move it */
-            self->history.message_views[i] = view;
-            if (self->history.selection_index == i - 1) {
-                self->history.selection_index = i;
-            }
-        }
+    height = (long)LINE_COUNT(self) * self->history.line_height;
 
+    /* If nothing was dropped then we'll have to move stuff down */
+    if (!is_dropped) {
         /* Move stuff down to make room */
         if (gc != None) {
             copy_area(self, display, window, gc,
@@ -1443,45 +2281,7 @@ insert_message(HistoryWidget self,
                       self->history.y + y + self->history.line_height);
         }
 
-        /* We've got another node */
-        self->history.message_count++;
     } else {
-        /* Discard the first message view */
-        message_view_free(self->history.message_views[0]);
-        if (self->history.selection_index == 0) {
-            self->history.selection_index = (unsigned int)-1;
-        }
-
-        /* Measure the nodes before the index, moving them up to make
-         * room for the new message. */
-        for (i = 0; i < index; i++) {
-            view = self->history.message_views[i + 1];
-
-            /* Measure the view */
-            message_view_get_sizes(view, show_timestamps, &sizes);
-            width = MAX(width, sizes.width);
-            y += self->history.line_height;
-            height += self->history.line_height;
-
-            /* Move it up */
-            self->history.message_views[i] = view;
-
-            /* Update the selection index */
-            if (self->history.selection_index == i + 1) {
-                self->history.selection_index = i;
-            }
-        }
-
-        /* Measure the nodes after the index */
-        for (i = index + 1; i < self->history.message_count; i++) {
-            view = self->history.message_views[i];
-
-            /* Measure the view */
-            message_view_get_sizes(view, show_timestamps, &sizes);
-            width = MAX(width, sizes.width);
-            height += self->history.line_height;
-        }
-
         /* Move stuff up to make room */
         if (gc != None) {
             copy_area(self, display, window, gc,
@@ -1492,18 +2292,25 @@ insert_message(HistoryWidget self,
         }
     }
 
-    /* Create a new message view */
-    /* FIX THIS: use a real conversion descriptor! */
-    view = message_view_alloc(message, indent, self->history.renderer);
-    self->history.message_views[index] = view;
+    /* Record the new line */
+    line.message = message;
+    line.serial = serial;
+    line.indent = indent;
+    line.width = message_width;
+    lines_insert(self, index, &line);
 
     /* Measure it */
-    message_view_get_sizes(view, show_timestamps, &sizes);
-    width = MAX(width, sizes.width);
+    widths_add(self, &line);
+    width = widths_max(self);
     height += self->history.line_height;
 
     /* Paint it */
+    view = NULL;
     if (gc != None) {
+        view = row_view(self, self->history.archive_count + index);
+    }
+
+    if (view != NULL) {
         /* Remove any remains of the previous message */
         XFillRectangle(display, window, gc,
                        0, self->history.margin_height -
@@ -1526,7 +2333,7 @@ insert_message(HistoryWidget self,
                            self->history.separator_pixel,
                            self->history.margin_width - self->history.x,
                            self->history.margin_height - self->history.y +
-                           y + self->history.font->ascent,
+                           y + utf8_renderer_ascent(self->history.renderer),
                            &bbox);
     }
 
@@ -1565,7 +2372,7 @@ make_index_visible(HistoryWidget self, unsigned int index)
     long y;
 
     /* Sanity check */
-    ASSERT(index < self->history.message_count);
+    ASSERT(index < LINE_COUNT(self));
 
     /* Figure out where the index would appear */
     y = self->history.selection_index * self->history.line_height;
@@ -1593,6 +2400,7 @@ set_selection(HistoryWidget self, unsigned int index, message_t message)
     Display *display = XtDisplay((Widget)self);
     Window window = XtWindow((Widget)self);
     GC gc = self->history.gc;
+    message_view_t view;
     XGCValues values;
     XRectangle bbox;
     long y;
@@ -1639,16 +2447,19 @@ set_selection(HistoryWidget self, unsigned int index, message_t message)
                 0, y, self->core.width, self->history.line_height);
 
             /* And then draw it again */
-            message_view_paint(
-                self->history.message_views[self->history.selection_index],
-                display, window, gc,
-                self->history.show_timestamps,
-                self->history.timestamp_pixel,
-                self->history.group_pixel, self->history.user_pixel,
-                self->history.string_pixel, self->history.separator_pixel,
-                self->history.margin_width - self->history.x,
-                y + self->history.font->ascent,
-                &bbox);
+            view = row_view(self, self->history.selection_index);
+            if (view != NULL) {
+                message_view_paint(
+                    view, display, window, gc,
+                    self->history.show_timestamps,
+                    self->history.timestamp_pixel,
+                    self->history.group_pixel, self->history.user_pixel,
+                    self->history.string_pixel,
+                    self->history.separator_pixel,
+                    self->history.margin_width - self->history.x,
+                    y + utf8_renderer_ascent(self->history.renderer),
+                    &bbox);
+            }
         }
     }
 
@@ -1685,16 +2496,19 @@ set_selection(HistoryWidget self, unsigned int index, message_t message)
             paint_highlight(self);
 
             /* And then draw the message view on top of it */
-            message_view_paint(
-                self->history.message_views[self->history.selection_index],
-                display, window, gc,
-                self->history.show_timestamps,
-                self->history.timestamp_pixel,
-                self->history.group_pixel, self->history.user_pixel,
-                self->history.string_pixel, self->history.separator_pixel,
-                self->history.margin_width - self->history.x,
-                y + self->history.font->ascent,
-                &bbox);
+            view = row_view(self, self->history.selection_index);
+            if (view != NULL) {
+                message_view_paint(
+                    view, display, window, gc,
+                    self->history.show_timestamps,
+                    self->history.timestamp_pixel,
+                    self->history.group_pixel, self->history.user_pixel,
+                    self->history.string_pixel,
+                    self->history.separator_pixel,
+                    self->history.margin_width - self->history.x,
+                    y + utf8_renderer_ascent(self->history.renderer),
+                    &bbox);
+            }
         }
 
         /* Try to make the entire selection is visible */
@@ -1709,25 +2523,43 @@ set_selection(HistoryWidget self, unsigned int index, message_t message)
 static void
 set_selection_index(HistoryWidget self, unsigned int index)
 {
-    message_view_t view;
+    message_t message;
 
-    /* Locate the message view at that index */
-    if (index < self->history.message_count) {
-        view = self->history.message_views[index];
+    /* Locate the message at that index */
+    if (index < LINE_COUNT(self)) {
+        message = row_message(self, index);
     } else {
         index = (unsigned int)-1;
-        view = NULL;
+        message = NULL;
     }
 
     /* Select it */
-    set_selection(self, index, view ? message_view_get_message(view) : NULL);
+    set_selection(self, index, message);
 }
 
 /* Destroy the widget */
 static void
-destroy(Widget self)
+destroy(Widget widget)
 {
+    HistoryWidget self = (HistoryWidget)widget;
+
     DPRINTF((3, "History.destroy()\n"));
+
+    /* Release the cached message views */
+    view_cache_flush(self);
+
+    /* And the archive */
+    if (self->history.archive != NULL) {
+        message_store_free(self->history.archive);
+        free(self->history.archive_widths);
+        free(self->history.archive_serials);
+    }
+
+    /* And the search index */
+    search_index_free(self->history.search_index);
+
+    /* And finally the renderer they were all drawn with */
+    utf8_renderer_free(self->history.renderer);
 }
 
 /* Resize the widget */
@@ -1865,8 +2697,7 @@ drag_timeout_cb(XtPointer closure, XtIntervalId *id)
 
         /* If we've already select the last message then make the
          * bottom margin visible */
-        if (self->history.selection_index ==
-            self->history.message_count - 1) {
+        if (self->history.selection_index == LINE_COUNT(self) - 1) {
             if (self->history.height >= self->core.height) {
                 set_origin(self, self->history.x,
                            self->history.height - self->core.height, 1);
@@ -1882,8 +2713,8 @@ drag_timeout_cb(XtPointer closure, XtIntervalId *id)
         index = index_of_y(self, y);
 
         /* Don't go past the last message */
-        if (index >= self->history.message_count) {
-            index = self->history.message_count - 1;
+        if (index >= LINE_COUNT(self)) {
+            index = LINE_COUNT(self) - 1;
         }
 
         /* Select */
@@ -1988,8 +2819,8 @@ do_select(Widget widget, XEvent *event, String *params, Cardinal *nparams)
 
     /* Anything past the last message is considered part of that
      * message for our purposes here */
-    if (index >= self->history.message_count) {
-        index = self->history.message_count - 1;
+    if (index >= LINE_COUNT(self)) {
+        index = LINE_COUNT(self) - 1;
     }
 
     set_selection_index(self, index);
@@ -2014,8 +2845,8 @@ toggle_selection(Widget widget,
              self->history.margin_height) / self->history.line_height;
 
     /* Are we selecting past the end of the list? */
-    if (index >= self->history.message_count) {
-        index = self->history.message_count - 1;
+    if (index >= LINE_COUNT(self)) {
+        index = LINE_COUNT(self) - 1;
     }
 
     /* Is this our current selection? */
@@ -2066,7 +2897,7 @@ select_previous(Widget widget,
     /* Is anything selected? */
     if (self->history.selection_index == (unsigned int)-1) {
         /* No.  Prepare to select the last item in the list */
-        index = self->history.message_count;
+        index = LINE_COUNT(self);
     } else {
         /* Yes.  Prepare to select the one before it */
         index = self->history.selection_index;
@@ -2092,7 +2923,7 @@ select_next(Widget widget, XEvent *event, String *params, Cardinal *nparams)
     index = self->history.selection_index + 1;
 
     /* Bail if there is no next item */
-    if (index >= self->history.message_count) {
+    if (index >= LINE_COUNT(self)) {
         return;
     }
 
@@ -2274,6 +3105,12 @@ void
 HistorySetThreaded(Widget widget, Boolean is_threaded)
 {
     HistoryWidget self = (HistoryWidget)widget;
+    struct archive_entry *entries;
+    unsigned int entry_count;
+    unsigned int selection_index;
+    unsigned long selection_serial;
+    Boolean is_rebuilt;
+    history_line_t line;
     int i, index;
     message_t message;
 
@@ -2282,48 +3119,103 @@ HistorySetThreaded(Widget widget, Boolean is_threaded)
         return;
     }
 
+    /* Remember which row the selection is on */
+    selection_index = self->history.selection_index;
+    selection_serial = 0;
+    if (selection_index < self->history.archive_count) {
+        selection_serial = ARCHIVE_SERIAL(self, selection_index);
+    } else if (selection_index != (unsigned int)-1) {
+        selection_serial = LINE_AT(
+            self, selection_index - self->history.archive_count).serial;
+    }
+
+    /* Note what's on each row so that the archive can be rebuilt */
+    entries = archive_entries(self, &entry_count);
+
     /* Change threaded status */
     self->history.is_threaded = is_threaded;
 
-    /* Get rid of all of the old message views */
-    for (i = 0; i < self->history.message_count; i++) {
-        message_view_free(self->history.message_views[i]);
-    }
+    /* Start the ring over at the beginning of the array */
+    self->history.line_base = 0;
 
-    /* Create a bunch of new message views accordingly */
+    /* Look for the selection among the new lines in case it doesn't
+     * show up */
+    selection_index = (unsigned int)-1;
+
+    /* Lay out the lines accordingly */
     if (is_threaded) {
         index = self->history.message_count - 1;
 
-        /* Clear the selection in case it doesn't show up */
-        self->history.selection_index = (unsigned int)-1;
-
         /* Traverse the history tree */
         node_populate(self->history.nodes,
-                      self->history.renderer,
-                      self->history.message_views,
+                      self->history.lines,
                       0, &index,
                       self->history.selection,
-                      &self->history.selection_index);
+                      &selection_index);
     } else {
-        /* Create a bunch of new ones */
+        /* One unindented line per message in order of receipt */
         index = self->history.message_index;
         for (i = 0; i < self->history.message_count; i++) {
             /* Look up the message */
             message = self->history.messages[index];
 
-            /* Wrap it in a message view */
-            self->history.message_views[i] =
-                message_view_alloc(message, 0, self->history.renderer);
+            /* Record its line */
+            line = &LINE_AT(self, i);
+            line->message = message;
+            line->serial = self->history.message_serial -
+                self->history.message_count + i;
+            line->indent = 0;
+            line->width = self->history.message_widths[index];
 
             /* Update the selection index */
             if (self->history.selection == message) {
-                self->history.selection_index = i;
+                selection_index = i;
             }
 
             index = (index + 1) % self->history.message_count;
         }
     }
 
+    /* Move the messages which are no longer on a line into the
+     * archive and those which now are out of it */
+    is_rebuilt = False;
+    if (entries != NULL) {
+        is_rebuilt = archive_rebuild(self, entries, entry_count) == 0;
+        free(entries);
+    }
+
+    if (is_rebuilt) {
+        /* Follow the selection to its new row */
+        if (self->history.selection_index != (unsigned int)-1) {
+            self->history.selection_index =
+                index_of_serial(self, selection_serial);
+        }
+
+        /* An archived selection is a copy of the message, so switch
+         * to the original if it's back on a line */
+        if (self->history.selection_index != (unsigned int)-1 &&
+            self->history.selection_index >= self->history.archive_count) {
+            line = &LINE_AT(self, self->history.selection_index -
+                            self->history.archive_count);
+            if (line->message != self->history.selection) {
+                MESSAGE_FREE_REF(self->history.selection, ref_selection,
+                                 self);
+                self->history.selection = line->message;
+                MESSAGE_ALLOC_REF(self->history.selection, ref_selection,
+                                  self);
+            }
+        }
+    } else if (selection_index != (unsigned int)-1) {
+        /* The selection is on one of the new lines */
+        self->history.selection_index =
+            self->history.archive_count + selection_index;
+    } else if (self->history.selection_index >=
+               self->history.archive_count) {
+        /* It's no longer on a line, but an archived selection stays
+         * where it is */
+        self->history.selection_index = (unsigned int)-1;
+    }
+
     /* Recompute the dimensions of the widget */
     recompute_dimensions(self);
 
@@ -2370,53 +3262,75 @@ void
 HistoryAddMessage(Widget widget, message_t message)
 {
     HistoryWidget self = (HistoryWidget)widget;
+    unsigned long serial = self->history.message_serial;
+    Boolean is_full;
+    Boolean is_dropped;
     node_t node;
+    long width;
     int index;
     int depth;
 
+    /* Measure the message once so that laying it out doesn't require
+     * a message view */
+    width = message_view_measure(message, self->history.renderer);
+
     /* Wrap the message in a node */
-    node = node_alloc(message);
+    node = node_alloc(message, serial, width);
     if (node == NULL) {
         return;
     }
 
+    /* If we're at capacity then make room for the new line while the
+     * message on the first line is still around to be archived */
+    is_full = self->history.message_count == self->history.message_capacity;
+    is_dropped = False;
+    if (is_full) {
+        is_dropped = discard_line(self);
+    }
+
     /* Add the node to the threaded history tree */
-    node_add(&self->history.nodes,
+    node_add(self,
              message_get_reply_id(message),
              node,
-             MIN(self->history.message_count + 1,
-                 self->history.message_capacity),
+             self->history.message_count + 1,
              &index,
              &depth);
 
     /* If we're not at capacity then just add a reference to the end
      * of the array of messages */
-    if (self->history.message_count < self->history.message_capacity) {
+    if (!is_full) {
         self->history.messages[self->history.message_count] = message;
+        self->history.message_widths[self->history.message_count] = width;
         MESSAGE_ALLOC_REF(message, ref_history, self);
     } else {
-        /* Free the old message */
+        /* Forget the old message's words and free it */
+        search_remove(self,
+                      self->history.message_serial -
+                      self->history.message_capacity,
+                      self->history.messages[self->history.message_index]);
         MESSAGE_FREE_REF(self->history.messages[self->history.message_index],
                          ref_history, self);
 
         /* Replace it with this message */
         self->history.messages[self->history.message_index] = message;
+        self->history.message_widths[self->history.message_index] = width;
         MESSAGE_ALLOC_REF(message, ref_history, self);
 
         self->history.message_index = (self->history.message_index + 1) %
             self->history.message_capacity;
     }
 
+    /* Make its words searchable */
+    search_add(self, serial, message);
+    self->history.message_serial++;
+
     /* Add the node according to our threadedness */
     if (HistoryIsThreaded(widget)) {
-        insert_message(self, index, depth, message);
+        insert_message(self, index, depth, message, serial, width,
+                       is_dropped);
     } else {
-        insert_message(
-            self,
-            self->history.message_count < self->history.message_capacity ?
-            self->history.message_count : self->history.message_capacity - 1,
-            0,
-            message);
+        insert_message(self, self->history.message_count, 0, message, serial,
+                       width, is_dropped);
     }
 }
 
@@ -2433,7 +3347,7 @@ HistoryKillThread(Widget widget, message_t message)
     }
 
     /* Look for the node which wraps the message */
-    node = node_find(self->history.nodes, message);
+    node = node_find(self, message);
     if (node == NULL) {
         /* The message is killed now */
         message_set_killed(message, True);
@@ -2454,9 +3368,9 @@ HistorySelect(Widget widget, message_t message)
     if (message != NULL) {
         /* Find the index of the message */
         for (i = 0; i < self->history.message_count; i++) {
-            if (message_view_get_message(self->history.message_views[i]) ==
-                message) {
-                set_selection(self, i, message);
+            if (LINE_AT(self, i).message == message) {
+                set_selection(self, self->history.archive_count + i,
+                              message);
                 return;
             }
         }
@@ -2472,15 +3386,30 @@ HistorySelectId(Widget widget, const char *message_id)
 {
     HistoryWidget self = (HistoryWidget)widget;
     message_t message;
+    node_t node;
     unsigned int i;
     const char *string;
 
+    /* The threaded history can look the message up directly */
+    if (message_id != NULL && self->history.is_threaded) {
+        node = hash_table_get(self->history.ids, message_id);
+        if (node != NULL) {
+            i = index_of_node(self, node);
+            if (i != (unsigned int)-1) {
+                set_selection(self, i, node->message);
+                return;
+            }
+        }
+
+        set_selection(self, (unsigned int)-1, NULL);
+        return;
+    }
+
     /* Save the effort if there's no id */
     if (message_id != NULL) {
         /* Find the index of the message */
         for (i = self->history.message_count; i > 0; --i) {
-            message =
-                message_view_get_message(self->history.message_views[i - 1]);
+            message = LINE_AT(self, i - 1).message;
             if (message == NULL) {
                 continue;
             }
@@ -2491,7 +3420,8 @@ HistorySelectId(Widget widget, const char *message_id)
             }
 
             if (strcmp(string, message_id) == 0) {
-                set_selection(self, i - 1, message);
+                set_selection(self, self->history.archive_count + i - 1,
+                              message);
                 return;
             }
         }
@@ -2510,6 +3440,96 @@ HistoryGetSelection(Widget widget)
     return self->history.selection;
 }
 
+/* Selects the newest message older than the last one found which
+ * contains every word of query and is on a line, starting over from
+ * the newest message when there are no more */
+message_t
+HistorySearch(Widget widget, const char *query)
+{
+    HistoryWidget self = (HistoryWidget)widget;
+    unsigned long serial = self->history.search_serial;
+    unsigned long newest = self->history.message_serial;
+    unsigned long oldest;
+    unsigned long before;
+    unsigned long limit;
+    Boolean is_wrapped;
+    message_t message;
+    unsigned int index;
+    node_t node;
+
+    /* Only the messages in the messages ring are searchable */
+    oldest = 0;
+    if (newest > self->history.message_capacity) {
+        oldest = newest - self->history.message_capacity;
+    }
+
+    /* Carry on from the last message found if it's still selected */
+    before = newest;
+    if (self->history.selection != NULL &&
+        oldest <= serial && serial < newest &&
+        self->history.messages[serial % self->history.message_capacity] ==
+        self->history.selection) {
+        before = serial;
+    }
+
+    /* Look for an older match on a line, wrapping around once if
+     * there isn't one.  Threaded messages whose nodes have been
+     * trimmed or scrolled off the top have no line to select. */
+    limit = 0;
+    is_wrapped = before == newest;
+    for (;;) {
+        if (search_index_find(self->history.search_index,
+                              query, before, &serial) < 0 ||
+            serial < limit) {
+            if (is_wrapped) {
+                return NULL;
+            }
+
+            /* Start over, stopping where the first pass began */
+            limit = before;
+            before = newest;
+            is_wrapped = True;
+            continue;
+        }
+
+        message = self->history.messages[
+            serial % self->history.message_capacity];
+
+        /* Find its line */
+        if (!self->history.is_threaded) {
+            index = self->history.archive_count +
+                (unsigned int)(serial - oldest);
+            break;
+        }
+
+        node = node_find(self, message);
+        index = node == NULL ?
+            (unsigned int)-1 : index_of_node(self, node);
+        if (index != (unsigned int)-1) {
+            break;
+        }
+
+        /* Keep looking from there */
+        before = serial;
+    }
+
+    self->history.search_serial = serial;
+    set_selection(self, index, message);
+    return message;
+}
+
+/* Fills in stats with the receiver's current statistics */
+void
+HistoryGetStats(Widget widget, history_stats_t stats)
+{
+    HistoryWidget self = (HistoryWidget)widget;
+
+    stats->copy_count = self->history.copy_total;
+    stats->compensate_count = self->history.compensate_total;
+    stats->overflow_count = self->history.overflow_total;
+    stats->full_redraw_count = self->history.full_redraw_total;
+}
+
 /*
  *
  * Class record initializations
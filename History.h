@@ -53,6 +53,7 @@
  ----                     -----                -------                -------------
  font                     Font                XFontStruct *        XtDefaultFont
  fontCodeSet             String                String                NULL
+ xftFont                 String                String                NULL
  timestampPixel             TimestampPixel        Pixel                Black
  groupPixel             GroupPixel                Pixel                Blue
  userPixel             UserPixel                Pixel                Green
@@ -60,7 +61,8 @@
  separatorPixel             SeparatorPixel        Pixel                Black
  marginWidth             MarginWidth        Dimension        5
  marginHeight             MarginHeight        Dimension        5
- messageCount             MessageCount        Dimension        32
+ messageCapacity     MessageCapacity        int                32
+ archiveCapacity     ArchiveCapacity        int                0
  selectionPixel             SelectionPixel        Pixel                Gray
  dragDelay             DragDelay                int                100
 
@@ -85,6 +87,9 @@
 #ifndef XtNfontCodeSet
 # define XtNfontCodeSet "fontCodeSet"
 #endif
+#ifndef XtNxftFont
+# define XtNxftFont "xftFont"
+#endif
 #ifndef XtNattachmentCallback
 # define XtNattachmentCallback "attachmentCallback"
 #endif
@@ -139,6 +144,12 @@
 #ifndef XtCMessageCapacity
 # define XtCMessageCapacity "MessageCapacity"
 #endif
+#ifndef XtNarchiveCapacity
+# define XtNarchiveCapacity "archiveCapacity"
+#endif
+#ifndef XtCArchiveCapacity
+# define XtCArchiveCapacity "ArchiveCapacity"
+#endif
 #ifndef XtNselectionPixel
 # define XtNselectionPixel "selectionPixel"
 #endif
@@ -209,4 +220,39 @@ message_t
 HistoryGetSelection(Widget widget);
 
 
+/* Selects the newest message older than the last one found which
+ * contains every word of query, starting over from the newest message
+ * when there are no more.  Words are compared without regard to ASCII
+ * case.  Archived messages aren't searched, nor are threaded ones
+ * which are no longer on a line.  Returns the selected message, or
+ * NULL if no message matches. */
+message_t
+HistorySearch(Widget widget, const char *query);
+
+
+/* Statistics about how a History has scrolled */
+typedef struct history_stats *history_stats_t;
+
+struct history_stats {
+    /* The number of XCopyArea requests made to scroll or make room */
+    unsigned long copy_count;
+
+    /* The number of exposures which were translated to
+     * compensate for outstanding copies */
+    unsigned long compensate_count;
+
+    /* The number of copies made while too many were outstanding to
+     * keep track of them */
+    unsigned long overflow_count;
+
+    /* The number of exposures which repainted the whole
+     * window because copies couldn't be tracked */
+    unsigned long full_redraw_count;
+};
+
+/* Fills in stats with the receiver's current statistics */
+void
+HistoryGetStats(Widget widget, history_stats_t stats);
+
+
 #endif /* HISTORY_H */
@@ -44,6 +44,9 @@
 
 #include "message.h"
 #include "message_view.h"
+#include "hash_table.h"
+#include "message_store.h"
+#include "search_index.h"
 #include "History.h"
 
 
@@ -60,12 +63,100 @@ typedef struct _HistoryClassRec {
 } HistoryClassRec;
 
 
-/* The type of outstanding movement events */
-typedef struct translation_queue *translation_queue_t;
-
 /* The history is stored as nodes in a tree and list */
 typedef struct node *node_t;
 
+/* The number of message views to keep around for painting */
+#define VIEW_CACHE_SIZE 128
+
+/* The number of lines whose views are painted together, one color at
+ * a time.  This must be small enough that all of their views fit in
+ * the view cache at once. */
+#define PAINT_BATCH_SIZE (VIEW_CACHE_SIZE / 2)
+
+/* The number of outstanding XCopyArea requests which we can
+ * compensate for */
+#define COPY_RING_SIZE 64
+
+/* We try to be efficient and use XCopyArea to scroll the history
+ * widget, relying on GraphicsExpose events to tell us which parts of
+ * the window to repaint afterwards.  Because of the asynchronous
+ * nature of this, it's possible that the area described in a
+ * GraphicsExpose event will be shifted by an XCopyArea before we have
+ * a chance to repaint the damaged region.  To compensate, we record
+ * each pending XCopyArea request in a ring and use this information
+ * to compensate. */
+typedef struct copy_record *copy_record_t;
+struct copy_record {
+    /* The sequence number of the XCopyArea request */
+    unsigned long request_id;
+
+    /* The X coordinate of the left edge of the XCopyArea request */
+    int left;
+
+    /* The Y coordinate of the left edge of the XCopyArea request */
+    int top;
+
+    /* The X coordinate of the right edge of XCopyArea request */
+    int right;
+
+    /* The Y coordinate of the bottom edge of the XCopyArea request */
+    int bottom;
+
+    /* The displacement in the X direction (positive is to the right) */
+    int dx;
+
+    /* The displacement in the Y direction (positive is down) */
+    int dy;
+};
+
+/* A line of the history.  Only the lines which are being painted
+ * have message views; the rest just record enough to lay them out. */
+typedef struct history_line *history_line_t;
+struct history_line {
+    /* The line's message.  This is kept alive by the tree node or
+     * messages entry which the line displays. */
+    message_t message;
+
+    /* The serial number of the line's message in order of receipt */
+    unsigned long serial;
+
+    /* The number of levels of indentation */
+    long indent;
+
+    /* The width of the message's view without indentation or
+     * timestamp */
+    long width;
+};
+
+/* A message view in the view cache */
+typedef struct view_cache_entry *view_cache_entry_t;
+struct view_cache_entry {
+    /* The view's message and indentation, or NULL and 0 for the
+     * view of an archived message */
+    message_t message;
+    long indent;
+
+    /* The archive serial number of an archived message's view */
+    unsigned long serial;
+
+    /* The view, or NULL if the entry is unused */
+    message_view_t view;
+
+    /* When the view was last used */
+    unsigned long used;
+};
+
+/* The number of lines of a given width */
+typedef struct width_count *width_count_t;
+struct width_count {
+    /* The width of the lines */
+    long width;
+
+    /* The number of lines that wide */
+    unsigned int count;
+};
+
 /* Which way are we dragging? */
 typedef enum {
     DRAG_NONE,
@@ -92,6 +183,9 @@ typedef struct {
     /* The code set used by the font */
     const char *code_set;
 
+    /* The name of the Xft font to use instead of the core font */
+    const char *xft_font;
+
     /* The color to use when drawing the timestamp */
     Pixel timestamp_pixel;
 
@@ -114,7 +208,10 @@ typedef struct {
     Dimension margin_height;
 
     /* The maximum number of messages to display in the history */
-    Dimension message_capacity;
+    unsigned int message_capacity;
+
+    /* The maximum number of older messages to keep in the archive */
+    unsigned int archive_capacity;
 
     /* The color to use when drawing the selection box */
     Pixel selection_pixel;
@@ -158,29 +255,135 @@ typedef struct {
     /* The y coordinate of the pointer during a drag operation */
     short pointer_y;
 
-    /* The queue of outstanding movements */
-    translation_queue_t tqueue;
+    /* The outstanding XCopyArea requests, oldest first.  This is a
+     * ring starting at copy_base. */
+    struct copy_record copies[COPY_RING_SIZE];
+
+    /* The position of the oldest outstanding copy in the ring */
+    unsigned int copy_base;
+
+    /* The number of outstanding copies in the ring */
+    unsigned int copy_count;
+
+    /* True if a copy didn't fit in the ring.  We can't tell where
+     * damage has moved to until the server has processed it, so
+     * exposures repaint the whole window until then. */
+    Boolean is_copy_overflow;
+
+    /* The sequence number of the last copy which didn't fit */
+    unsigned long copy_overflow_id;
+
+    /* The number of XCopyArea requests made */
+    unsigned long copy_total;
 
-    /* The end of the queue */
-    translation_queue_t tqueue_end;
+    /* The number of exposures compensated for copies */
+    unsigned long compensate_total;
+
+    /* The number of copies which didn't fit in the ring */
+    unsigned long overflow_total;
+
+    /* The number of exposures repainted in full */
+    unsigned long full_redraw_total;
 
     /* Non-zero if the history should display threads */
     Boolean is_threaded;
 
-    /* The history as both tree and list */
+    /* The history as both tree and list, starting with the youngest
+     * thread */
     node_t nodes;
 
+    /* The eldest thread in the tree */
+    node_t eldest;
+
+    /* The number of nodes in the tree, including those which have
+     * scrolled off the top but still have visible replies */
+    long node_count;
+
+    /* The nodes indexed by message id */
+    hash_table_t ids;
+
+    /* A Fenwick tree of the sizes of the threads, indexed by their
+     * serial numbers modulo thread_slots */
+    long *thread_sizes;
+
+    /* The number of slots in thread_sizes (a power of two) */
+    unsigned int thread_slots;
+
+    /* The serial number to give the next thread */
+    unsigned long thread_serial;
+
     /* The messages in order of receipt */
     message_t *messages;
 
-    /* The number of message_views in the history */
+    /* The widths of the messages' views, without indentation or
+     * timestamps, in the same order */
+    long *message_widths;
+
+    /* The number of lines in the history, not counting archived
+     * ones */
     unsigned int message_count;
 
     /* The first index messages circular array */
     unsigned int message_index;
 
-    /* An array of message_views in display order */
-    message_view_t *message_views;
+    /* The number of messages ever added.  The message with serial
+     * number n is kept in messages[n % message_capacity]. */
+    unsigned long message_serial;
+
+    /* The words of the messages in messages by serial number */
+    search_index_t search_index;
+
+    /* The serial number of the last message found by HistorySearch */
+    unsigned long search_serial;
+
+    /* A ring of lines in display order */
+    history_line_t lines;
+
+    /* The slot in lines which holds the first line */
+    unsigned int line_base;
+
+    /* The messages which have scrolled off the top of the lines, in
+     * the order they did so, or NULL if there's no archive.  Archived
+     * lines are displayed above the others, without indentation.
+     * Changing the threading rebuilds it in order of receipt from the
+     * messages which are no longer on a line. */
+    message_store_t archive;
+
+    /* The widths of the archived messages' views, without
+     * timestamps, as a ring starting at archive_base */
+    long *archive_widths;
+
+    /* The serial numbers of the archived messages in order of
+     * receipt, in the same ring as their widths */
+    unsigned long *archive_serials;
+
+    /* The slot in archive_widths of the oldest archived message */
+    unsigned int archive_base;
+
+    /* The number of archived messages */
+    unsigned int archive_count;
+
+    /* The number of messages which have ever been archived */
+    unsigned long archive_serial;
+
+    /* The message views of recently painted lines */
+    struct view_cache_entry view_cache[VIEW_CACHE_SIZE];
+
+    /* Incremented each time a cached view is used */
+    unsigned long view_clock;
+
+    /* The width of one level of indentation */
+    long indent_width;
+
+    /* The width that timestamps add to each line */
+    long timestamp_width;
+
+    /* The distinct widths of the lines in increasing order along
+     * with the number of lines of each width */
+    width_count_t widths;
+
+    /* The number of distinct widths */
+    unsigned int width_count;
 
     /* The currently selected message_t (NULL if none) */
     message_t selection;
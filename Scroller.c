@@ -42,7 +42,7 @@
 #endif
 #include <stdio.h> /* atoi, fprintf */
 #ifdef HAVE_STDLIB_H
-# include <stdlib.h> /* calloc, free, malloc */
+# include <stdlib.h> /* abs, calloc, free, malloc */
 #endif
 #ifdef HAVE_STRING_H
 # include <string.h> /* memset */
@@ -50,7 +50,21 @@
 #ifdef HAVE_ASSERT_H
 # include <assert.h> /* assert */
 #endif
+#ifdef HAVE_TIME_H
+# include <time.h> /* clock_gettime */
+#endif
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h> /* gettimeofday */
+#endif
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#if defined(HAVE_X11_EXTENSIONS_XSHM_H) && defined(HAVE_SYS_SHM_H) && \
+    defined(HAVE_XSHMQUERYEXTENSION)
+# define USE_XSHM 1
+# include <sys/ipc.h> /* IPC_PRIVATE */
+# include <sys/shm.h> /* shmat, shmctl, shmdt, shmget */
+# include <X11/extensions/XShm.h>
+#endif
 #include <X11/IntrinsicP.h>
 #include <X11/StringDefs.h>
 #include <X11/CoreP.h>
@@ -104,6 +118,12 @@ static XtResource resources[] =
         offset(scroller.code_set), XtRString, (XtPointer)NULL
     },
 
+    /* The name of a scalable font to use instead */
+    {
+        XtNxftFont, XtCString, XtRString, sizeof(char *),
+        offset(scroller.xft_font), XtRString, (XtPointer)NULL
+    },
+
     /* Pixel groupPixel */
     {
         XtNgroupPixel, XtCGroupPixel, XtRPixel, sizeof(Pixel),
@@ -146,6 +166,18 @@ static XtResource resources[] =
         offset(scroller.use_pixmap), XtRImmediate, (XtPointer)False
     },
 
+    /* Boolean cache_glyphs */
+    {
+        XtNcacheGlyphs, XtCCacheGlyphs, XtRBoolean, sizeof(Boolean),
+        offset(scroller.cache_glyphs), XtRImmediate, (XtPointer)True
+    },
+
+    /* Boolean use_image */
+    {
+        XtNuseImage, XtCUseImage, XtRBoolean, sizeof(Boolean),
+        offset(scroller.use_image), XtRImmediate, (XtPointer)False
+    },
+
     /* Dimension frequency (in Hz) */
     {
         XtNfrequency, XtCFrequency, XtRDimension, sizeof(Dimension),
@@ -156,10 +188,43 @@ static XtResource resources[] =
     {
         XtNstepSize, XtCStepSize, XtRPosition, sizeof(Position),
         offset(scroller.step), XtRImmediate, (XtPointer)1
+    },
+
+    /* Boolean adaptive_speed */
+    {
+        XtNadaptiveSpeed, XtCAdaptiveSpeed, XtRBoolean, sizeof(Boolean),
+        offset(scroller.adaptive_speed), XtRImmediate, (XtPointer)False
     }
 };
 #undef offset
 
+/* The largest glyph we're willing to render into an off-screen
+ * pixmap.  The protocol limits pixmap dimensions to 16 bits. */
+#define MAX_GLYPH_PIXMAP_WIDTH 32767
+
+/* The longest interval between frames that we'll try to make up for
+ * by scrolling further (in seconds) */
+#define MAX_FRAME_INTERVAL 1.0
+
+/* How often to reconsider the scrolling speed when adaptive_speed is
+ * set (in seconds) */
+#define ADAPT_INTERVAL 1.0
+
+/* The most that adaptive_speed may multiply the scrolling speed by */
+#define MAX_SPEED_FACTOR 8.0
+
+/* The number of objects allocated at a time by an object_pool */
+#define POOL_BLOCK_COUNT 64
+
+/* The fade wheel level of a glyph which isn't waiting to fade */
+#define FADE_UNSCHEDULED -2
+
+/* The fade wheel level of a glyph which is due to fade on this tick */
+#define FADE_DUE -1
+
+/* The mask used to find a fade wheel slot */
+#define FADE_WHEEL_MASK (FADE_WHEEL_SLOTS - 1)
+
 
 /*
  * Method declarations
@@ -170,14 +235,109 @@ scroll(ScrollerWidget self, int offset);
 static void
 redisplay(ScrollerWidget self, Region region);
 static void
+add_damage(ScrollerWidget self, int x, unsigned int width);
+static void
+flush_damage(ScrollerWidget self);
+static void
 gexpose(Widget widget, XtPointer rock, XEvent *event, Boolean *ignored);
 static void
+visibility(Widget widget, XtPointer rock, XEvent *event, Boolean *ignored);
+static void
 paint(ScrollerWidget self,
       int x,
       int y,
       unsigned int width,
       unsigned int height);
 
+/* Used to align the objects in an object_pool's blocks */
+typedef union {
+    void *pointer;
+    double number;
+    long integer;
+} pool_align_t;
+
+/* Prepares a pool to hand out objects of the given size */
+static void
+pool_init(object_pool_t pool, size_t size)
+{
+    /* Round the size up so that every object is aligned */
+    pool->size = (size + sizeof(pool_align_t) - 1) /
+                 sizeof(pool_align_t) * sizeof(pool_align_t);
+    pool->free_list = NULL;
+    pool->blocks = NULL;
+    pool->count = 0;
+    pool->peak = 0;
+    pool->bytes = 0;
+}
+
+/* Returns an object from the pool, or NULL if memory is exhausted */
+static void *
+pool_alloc(object_pool_t pool)
+{
+    pool_align_t *block;
+    char *object;
+    int i;
+
+    /* Carve up another block if we've run out of objects */
+    if (pool->free_list == NULL) {
+        block = malloc(sizeof(pool_align_t) + POOL_BLOCK_COUNT * pool->size);
+        if (block == NULL) {
+            return NULL;
+        }
+
+        /* The first word links the blocks together */
+        block->pointer = pool->blocks;
+        pool->blocks = block;
+        pool->bytes += sizeof(pool_align_t) + POOL_BLOCK_COUNT * pool->size;
+
+        /* The rest is objects */
+        object = (char *)(block + 1);
+        for (i = 0; i < POOL_BLOCK_COUNT; i++) {
+            *(void **)object = pool->free_list;
+            pool->free_list = object;
+            object += pool->size;
+        }
+    }
+
+    /* Pop an object off the free list */
+    object = pool->free_list;
+    pool->free_list = *(void **)object;
+
+    pool->count++;
+    if (pool->peak < pool->count) {
+        pool->peak = pool->count;
+    }
+
+    return object;
+}
+
+/* Returns an object to the pool */
+static void
+pool_free(object_pool_t pool, void *object)
+{
+    ASSERT(pool->count > 0);
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+    pool->count--;
+}
+
+/* Releases all of the pool's memory, including any objects still in
+ * use */
+static void
+pool_destroy(object_pool_t pool)
+{
+    pool_align_t *block;
+
+    while ((block = pool->blocks) != NULL) {
+        pool->blocks = block->pointer;
+        free(block);
+    }
+
+    pool->free_list = NULL;
+    pool->count = 0;
+    pool->bytes = 0;
+}
+
 #if defined(DEBUG)
 static const char *ref_copy = "copy";
 static const char *ref_gap = "gap";
@@ -231,15 +391,52 @@ struct glyph {
     /* Is this glyph expired? */
     Bool is_expired;
 
-    /* Our timeout's id or None */
-    XtIntervalId timeout;
+    /* The time at which the glyph's message will expire (in seconds) */
+    double expiry;
+
+    /* The fade wheel tick at which the glyph should next fade */
+    unsigned long deadline;
+
+    /* The fade wheel level holding the glyph, FADE_DUE or
+     * FADE_UNSCHEDULED */
+    int wheel_level;
+
+    /* The fade wheel slot holding the glyph */
+    int wheel_slot;
+
+    /* The previous glyph in the same fade wheel slot */
+    glyph_t wheel_previous;
+
+    /* The next glyph in the same fade wheel slot */
+    glyph_t wheel_next;
+
+    /* True if the glyph has faded since it was last painted */
+    Bool needs_repaint;
+
+    /* The glyph rendered off-screen or None.  This only exists while
+     * the glyph is visible. */
+    Pixmap pixmap;
+
+    /* The fade level at which the pixmap was rendered or -1 if it
+     * needs to be rendered again */
+    int pixmap_level;
+
+    /* A client-side copy of the pixmap for the image backend or NULL */
+    XImage *image;
+
+    /* The fade level of the image or -1 if it needs to be fetched */
+    int image_level;
 };
 
 /* Forward declaration */
 static void
 glyph_free(glyph_t self);
 static void
+glyph_release_pixmap(glyph_t self);
+static void
 glyph_set_clock(glyph_t self, int level_count);
+static void
+fade_wheel_set_clock(ScrollerWidget self);
 
 #if defined(DEBUG_GLYPH)
 # define GLYPH_ALLOC_REF(glyph, type, rock)                     \
@@ -267,6 +464,115 @@ glyph_set_clock(glyph_t self, int level_count);
     } while (0)
 #endif /* DEBUG_GLYPH */
 
+/* Returns the current time in seconds.  Use a monotonic clock if we
+ * can so that changes to the system time don't upset the scrolling. */
+static double
+current_time(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else /* !HAVE_CLOCK_GETTIME || !CLOCK_MONOTONIC */
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1e6;
+#endif /* HAVE_CLOCK_GETTIME && CLOCK_MONOTONIC */
+}
+
+/* Returns the current time in fade wheel ticks */
+static unsigned long
+fade_wheel_now(void)
+{
+    return (unsigned long)(current_time() * (1000 / FADE_WHEEL_RESOLUTION));
+}
+
+/* Returns the list containing the glyph */
+static glyph_t *
+fade_wheel_list(ScrollerWidget self, glyph_t glyph)
+{
+    if (glyph->wheel_level == FADE_DUE) {
+        return &self->scroller.fade_due;
+    }
+
+    return &self->scroller.fade_wheel[glyph->wheel_level][glyph->wheel_slot];
+}
+
+/* Puts a glyph into the fade wheel slot corresponding to its deadline */
+static void
+fade_wheel_link(ScrollerWidget self, glyph_t glyph)
+{
+    unsigned long base = self->scroller.fade_time;
+    unsigned long deadline = glyph->deadline;
+    unsigned long delta;
+    glyph_t *list;
+    int level;
+
+    /* Deadlines which have already passed are due on the next tick */
+    if ((long)(deadline - base) < 0) {
+        deadline = base;
+    }
+
+    /* Find the finest level which can hold the deadline */
+    delta = deadline - base;
+    for (level = 0; level < FADE_WHEEL_LEVELS - 1; level++) {
+        if (delta < 1UL << ((level + 1) * FADE_WHEEL_BITS)) {
+            break;
+        }
+    }
+
+    /* Deadlines beyond the end of the wheel will be cascaded back
+     * into the last level until they come within range */
+    if (!(delta < 1UL << (FADE_WHEEL_LEVELS * FADE_WHEEL_BITS))) {
+        deadline = base + (1UL << (FADE_WHEEL_LEVELS * FADE_WHEEL_BITS)) - 1;
+    }
+
+    glyph->wheel_level = level;
+    glyph->wheel_slot = (deadline >> (level * FADE_WHEEL_BITS)) &
+                        FADE_WHEEL_MASK;
+
+    /* Push it onto the slot's list */
+    list = fade_wheel_list(self, glyph);
+    glyph->wheel_previous = NULL;
+    glyph->wheel_next = *list;
+    if (*list != NULL) {
+        (*list)->wheel_previous = glyph;
+    }
+
+    *list = glyph;
+}
+
+/* Removes a glyph from its fade wheel slot */
+static void
+fade_wheel_unlink(ScrollerWidget self, glyph_t glyph)
+{
+    if (glyph->wheel_previous != NULL) {
+        glyph->wheel_previous->wheel_next = glyph->wheel_next;
+    } else {
+        *fade_wheel_list(self, glyph) = glyph->wheel_next;
+    }
+
+    if (glyph->wheel_next != NULL) {
+        glyph->wheel_next->wheel_previous = glyph->wheel_previous;
+    }
+
+    glyph->wheel_previous = NULL;
+    glyph->wheel_next = NULL;
+    glyph->wheel_level = FADE_UNSCHEDULED;
+}
+
+/* Stops the glyph from fading any further */
+static void
+glyph_clear_clock(glyph_t self)
+{
+    if (self->wheel_level != FADE_UNSCHEDULED) {
+        fade_wheel_unlink(self->widget, self);
+        self->widget->scroller.fade_count--;
+    }
+}
+
 /* Allocates and initializes a new glyph holder for the given message */
 static glyph_t
 glyph_alloc(ScrollerWidget widget, message_t message)
@@ -274,13 +580,18 @@ glyph_alloc(ScrollerWidget widget, message_t message)
     glyph_t self;
 
     /* Allocate memory for a new glyph */
-    self = malloc(sizeof(struct glyph));
+    self = pool_alloc(&widget->scroller.glyph_pool);
     if (self == NULL) {
         return NULL;
     }
 
     /* Initialize its fields to sane values */
     memset(self, 0, sizeof(struct glyph));
+    self->pixmap = None;
+    self->pixmap_level = -1;
+    self->image = NULL;
+    self->image_level = -1;
+    self->wheel_level = FADE_UNSCHEDULED;
 
     /* Increment the reference count */
     self->widget = widget;
@@ -302,13 +613,21 @@ glyph_alloc(ScrollerWidget widget, message_t message)
     /* Figure out how big the glyph should be */
     message_view_get_sizes(self->message_view, False, &self->sizes);
 
+    /* Remember when the message will expire */
+    self->expiry = current_time() + message_get_timeout(message);
+
     /* Add a little space on the end */
     /* FIX THIS: compute the per_char info for a space */
-    self->sizes.width += widget->scroller.font->ascent;
+    self->sizes.width += utf8_renderer_ascent(widget->scroller.renderer);
+
+    /* Bring an idle fade wheel up to date before using it */
+    if (widget->scroller.fade_count == 0) {
+        widget->scroller.fade_time = fade_wheel_now();
+    }
 
     /* Start the clock */
-    self->timeout = None;
     glyph_set_clock(self, widget->scroller.fade_levels);
+    fade_wheel_set_clock(widget);
 
     return self;
 }
@@ -339,25 +658,23 @@ glyph_free(glyph_t self)
         message_view_free(self->message_view);
     }
 
-    /* Cancel any pending timeout */
-    if (self->timeout != None) {
-        XtRemoveTimeOut(self->timeout);
-    }
+    /* Take it out of the fade wheel */
+    glyph_clear_clock(self);
+
+    /* Release the off-screen rendering */
+    glyph_release_pixmap(self);
 
     /* Free the glyph itself */
     DPRINTF((1, "freeing glyph %p with message %p\n", self, message));
-    free(self);
+    pool_free(&self->widget->scroller.glyph_pool, self);
 }
 
 /* This is called each time the glyph should fade */
 static void
-glyph_tick(XtPointer closure, XtIntervalId *id)
+glyph_tick(glyph_t self)
 {
-    glyph_t self = (glyph_t)closure;
-    int level_count = self->widget->scroller.fade_levels;
-
-    /* We don't have a timeout */
-    self->timeout = None;
+    ScrollerWidget widget = self->widget;
+    int level_count = widget->scroller.fade_levels;
 
     /* Have we faded through all of the levels yet? */
     if (self->fade_level + 1 >= level_count) {
@@ -375,18 +692,23 @@ glyph_tick(XtPointer closure, XtIntervalId *id)
     self->fade_level++;
     glyph_set_clock(self, level_count);
 
-    /* Redraw this glyph */
-    ScRepaintGlyph(self->widget, self);
+    /* Redraw this glyph along with any others which fade on this tick */
+    if (self->holder_count > 0) {
+        self->needs_repaint = True;
+        widget->scroller.fade_dirty = True;
+    }
 }
 
 /* Set the clock for the next time we need to fade this widget */
 static void
 glyph_set_clock(glyph_t self, int level_count)
 {
-    int duration;
+    ScrollerWidget widget = self->widget;
+    unsigned long now;
+    unsigned long duration;
 
     /* Sanity check */
-    ASSERT(self->timeout == None);
+    ASSERT(self->wheel_level == FADE_UNSCHEDULED);
 
     /* Has the glyph expired? */
     if (self->is_expired) {
@@ -398,9 +720,19 @@ glyph_set_clock(glyph_t self, int level_count)
         duration = 1000 * message_get_timeout(message) / level_count;
     }
 
-    self->timeout = XtAppAddTimeOut(
-        XtWidgetToApplicationContext((Widget)self->widget),
-        duration, glyph_tick, self);
+    /* Convert the duration into fade wheel ticks */
+    duration = MAX((duration + FADE_WHEEL_RESOLUTION - 1) /
+                   FADE_WHEEL_RESOLUTION, 1);
+
+    /* Never schedule anything for a tick that's already been processed */
+    now = fade_wheel_now();
+    if ((long)(now - widget->scroller.fade_time) < 0) {
+        now = widget->scroller.fade_time;
+    }
+
+    self->deadline = now + duration;
+    fade_wheel_link(widget, self);
+    widget->scroller.fade_count++;
 }
 
 /* Returns the glyph's message */
@@ -430,6 +762,124 @@ glyph_is_killed(glyph_t self)
     return message_is_killed(message);
 }
 
+/* Returns the total width of the glyph */
+static long
+glyph_get_width(glyph_t self);
+
+/* Renders the glyph into its off-screen pixmap at its current fade
+ * level.  Returns non-zero if the pixmap may be used to paint the
+ * glyph. */
+static int
+glyph_render(glyph_t self)
+{
+    ScrollerWidget widget = self->widget;
+    Display *display;
+    XRectangle bbox;
+    long width;
+
+    /* Don't bother if caching is disabled or impossible.  The image
+     * backend always needs the rendering. */
+    if ((!widget->scroller.cache_glyphs && widget->scroller.image == NULL) ||
+        !XtIsRealized((Widget)widget)) {
+        return 0;
+    }
+
+    /* Give up on glyphs which are too wide for a pixmap */
+    width = glyph_get_width(self);
+    if (width <= 0 || MAX_GLYPH_PIXMAP_WIDTH < width) {
+        return 0;
+    }
+
+    /* Is the pixmap already up to date? */
+    if (self->pixmap != None && self->pixmap_level == self->fade_level) {
+        return 1;
+    }
+
+    /* Create a pixmap if we don't already have one */
+    display = XtDisplay((Widget)widget);
+    if (self->pixmap == None) {
+        self->pixmap = XCreatePixmap(display, XtWindow((Widget)widget),
+                                     width, widget->scroller.height,
+                                     widget->core.depth);
+    }
+
+    /* Clear it to the background color */
+    XFillRectangle(display, self->pixmap, widget->scroller.backgroundGC,
+                   0, 0, width, widget->scroller.height);
+
+    /* Draw the message into it */
+    bbox.x = 0;
+    bbox.y = 0;
+    bbox.width = width;
+    bbox.height = widget->scroller.height;
+    message_view_paint(
+        self->message_view,
+        display, self->pixmap, widget->scroller.glyphGC,
+        False, 0,
+        widget->scroller.group_pixels[self->fade_level],
+        widget->scroller.user_pixels[self->fade_level],
+        widget->scroller.string_pixels[self->fade_level],
+        widget->scroller.separator_pixels[self->fade_level],
+        -MIN(self->sizes.lbearing, 0),
+        utf8_renderer_ascent(widget->scroller.renderer), &bbox);
+
+    self->pixmap_level = self->fade_level;
+    return 1;
+}
+
+/* Releases the glyph's off-screen pixmap and image */
+static void
+glyph_release_pixmap(glyph_t self)
+{
+    if (self->pixmap != None) {
+        XFreePixmap(XtDisplay((Widget)self->widget), self->pixmap);
+        self->pixmap = None;
+        self->pixmap_level = -1;
+    }
+
+    if (self->image != NULL) {
+        XDestroyImage(self->image);
+        self->image = NULL;
+        self->image_level = -1;
+    }
+}
+
+/* Returns a client-side image of the glyph at its current fade level,
+ * or NULL if one can't be made */
+static XImage *
+glyph_get_image(glyph_t self)
+{
+    Display *display;
+
+    /* Is the image already up to date? */
+    if (self->image != NULL && self->image_level == self->fade_level) {
+        return self->image;
+    }
+
+    /* Render the glyph on the server */
+    if (!glyph_render(self)) {
+        return NULL;
+    }
+
+    /* And bring it back here */
+    display = XtDisplay((Widget)self->widget);
+    if (self->image != NULL) {
+        XDestroyImage(self->image);
+    }
+
+    self->image = XGetImage(display, self->pixmap, 0, 0,
+                            glyph_get_width(self),
+                            self->widget->scroller.height,
+                            AllPlanes, ZPixmap);
+    self->image_level = self->image == NULL ? -1 : self->fade_level;
+
+    /* The server's copy isn't needed until the glyph fades again */
+    XFreePixmap(display, self->pixmap);
+    self->pixmap = None;
+    self->pixmap_level = -1;
+    return self->image;
+}
+
 /* Draw the glyph */
 static void
 glyph_paint(Display *display,
@@ -440,12 +890,33 @@ glyph_paint(Display *display,
             int y,
             XRectangle *bbox)
 {
+    int top, left, right, bottom;
+
     /* If we're the gap then there's nothing to do */
     if (self->message_view == NULL) {
         return;
     }
 
-    /* Delegate to the message_view */
+    /* Copy the pre-rendered glyph into place if we can */
+    if (glyph_render(self)) {
+        /* Clip the pixmap to the bounding box */
+        top = y - utf8_renderer_ascent(self->widget->scroller.renderer);
+        left = MAX(x, bbox->x);
+        right = MIN(x + glyph_get_width(self), bbox->x + bbox->width);
+        bottom = MIN(top + self->widget->scroller.height,
+                     bbox->y + bbox->height);
+        if (left < right && MAX(top, bbox->y) < bottom) {
+            XCopyArea(display, self->pixmap, drawable,
+                      self->widget->scroller.glyphGC,
+                      left - x, MAX(top, bbox->y) - top,
+                      right - left, bottom - MAX(top, bbox->y),
+                      left, MAX(top, bbox->y));
+        }
+
+        return;
+    }
+
+    /* Otherwise delegate to the message_view */
     message_view_paint(
         self->message_view,
         display, drawable, gc,
@@ -568,12 +1039,9 @@ glyph_expire(glyph_t self, ScrollerWidget widget)
     ScRepaintGlyph(widget, self);
 
     /* Restart the timer so that we can quickly fade */
-    if (self->timeout != None) {
-        XtRemoveTimeOut(self->timeout);
-        self->timeout = None;
-    }
-
+    glyph_clear_clock(self);
     glyph_set_clock(self, widget->scroller.fade_levels);
+    fade_wheel_set_clock(widget);
     ScGlyphExpired(widget, self);
 }
 
@@ -598,6 +1066,9 @@ queue_is_empty(glyph_t head)
 static void
 queue_add(glyph_t tail, glyph_t glyph)
 {
+    message_t message = glyph_get_message(glyph);
+    const char *tag;
+
     glyph->previous = tail;
     glyph->next = tail->next;
 
@@ -605,48 +1076,34 @@ queue_add(glyph_t tail, glyph_t glyph)
     tail->next = glyph;
 
     GLYPH_ALLOC_REF(glyph, ref_queue, NULL);
+
+    /* Index the glyph by its tag.  If this fails then a replacement
+     * will simply be added as a new message. */
+    tag = message == NULL ? NULL : message_get_tag(message);
+    if (tag != NULL) {
+        hash_table_put(glyph->widget->scroller.tags, tag, glyph);
+    }
 }
 
 /* Locates the item in the queue with the given tag */
 static glyph_t
-queue_find(glyph_t head, const char *tag)
+queue_find(ScrollerWidget self, const char *tag)
 {
-    glyph_t probe;
-
     /* Bail out now if there is no tag */
     if (tag == NULL) {
         return NULL;
     }
 
-    /* Look for the tag in the queue */
-    for (probe = head->next; probe != head; probe = probe->next) {
-        message_t message;
-        const char *probe_tag;
-
-        /* Check for a match */
-        message = glyph_get_message(probe);
-        if (message == NULL) {
-            continue;
-        }
-
-        probe_tag = message_get_tag(message);
-        if (probe_tag == NULL) {
-            continue;
-        }
-
-        if (strcmp(tag, probe_tag) == 0) {
-            return probe;
-        }
-    }
-
-    /* Not found */
-    return NULL;
+    return hash_table_get(self->scroller.tags, tag);
 }
 
 /* Replace an existing queue item with a new one with the same tag */
 static void
 queue_replace(glyph_t old_glyph, glyph_t new_glyph)
 {
+    hash_table_t tags = new_glyph->widget->scroller.tags;
+    const char *tag;
+
     /* Swap the message into place */
     new_glyph->previous = old_glyph->previous;
     old_glyph->previous->next = new_glyph;
@@ -656,6 +1113,13 @@ queue_replace(glyph_t old_glyph, glyph_t new_glyph)
     old_glyph->next->previous = new_glyph;
     old_glyph->next = NULL;
 
+    /* Point the tag at the new glyph, or at least stop it from
+     * pointing at the old one */
+    tag = message_get_tag(glyph_get_message(new_glyph));
+    if (hash_table_put(tags, tag, new_glyph) < 0) {
+        hash_table_remove(tags, tag);
+    }
+
     /* The queue now has a reference to the new glyph and no longer
      * has one to the old one. */
     GLYPH_ALLOC_REF(new_glyph, ref_queue, NULL);
@@ -666,12 +1130,23 @@ queue_replace(glyph_t old_glyph, glyph_t new_glyph)
 static void
 queue_remove(glyph_t glyph)
 {
+    hash_table_t tags = glyph->widget->scroller.tags;
+    message_t message;
+    const char *tag;
+
     /* Don't dequeue if the glyph isn't queued */
     if (glyph->next == NULL) {
         ASSERT(glyph->previous == NULL);
         return;
     }
 
+    /* Remove it from the tag index */
+    message = glyph_get_message(glyph);
+    tag = message == NULL ? NULL : message_get_tag(message);
+    if (tag != NULL && hash_table_get(tags, tag) == glyph) {
+        hash_table_remove(tags, tag);
+    }
+
     /* Remove it from the list */
     glyph->previous->next = glyph->next;
     glyph->next->previous = glyph->previous;
@@ -709,7 +1184,7 @@ glyph_holder_alloc(glyph_t glyph, int width)
     glyph_holder_t self;
 
     /* Allocate memory for the receiver */
-    self = malloc(sizeof(struct glyph_holder));
+    self = pool_alloc(&glyph->widget->scroller.holder_pool);
     if (self == NULL) {
         return NULL;
     }
@@ -737,6 +1212,7 @@ static void
 glyph_holder_free(glyph_holder_t self)
 {
     glyph_t glyph = self->glyph;
+    ScrollerWidget widget = glyph->widget;
 
     /* The glyph has one fewer holder. */
     ASSERT(glyph->holder_count > 0);
@@ -753,6 +1229,10 @@ glyph_holder_free(glyph_holder_t self)
             glyph->successor->predecessor = glyph->predecessor;
         }
 
+        /* Don't hang on to the rendering of an invisible glyph */
+        glyph_release_pixmap(glyph);
+        glyph->needs_repaint = False;
+
         /* If the glyph is expired then remove it from the queue
          * unless its the ultimate successor of a glyph that's still
          * visible. */
@@ -765,15 +1245,7 @@ glyph_holder_free(glyph_holder_t self)
 
     /* Lose our reference to the glyph */
     GLYPH_FREE_REF(glyph, ref_holder, self);
-    free(self);
-}
-
-/* Returns the glyph holder's tag, or NULL if it has none. */
-static const char *
-glyph_holder_get_tag(glyph_holder_t self)
-{
-    message_t message = glyph_get_message(self->glyph);
-    return message == NULL ? NULL : message_get_tag(message);
+    pool_free(&widget->scroller.holder_pool, self);
 }
 
 /* Paints the holder's glyph */
@@ -790,6 +1262,420 @@ glyph_holder_paint(Display *display,
     glyph_paint(display, drawable, gc, self->glyph, x, y, bbox);
 }
 
+/* The client-side rendering of the scroller used by the image
+ * backend.  Frames are composed here and sent to the server with a
+ * single request. */
+struct scroller_image {
+    /* The frames.  With shared memory we alternate between two so
+     * that we never scribble on the one the server may be reading. */
+    XImage *frames[2];
+
+#if defined(USE_XSHM)
+    /* The shared memory segments holding the frames */
+    XShmSegmentInfo segments[2];
+#endif /* USE_XSHM */
+
+    /* The number of frames in use */
+    int frame_count;
+
+    /* The index of the frame currently on the screen */
+    int current;
+
+    /* True if the frames live in shared memory */
+    Bool is_shared;
+
+    /* The number of bytes per pixel, or 0 if pixels aren't a whole
+     * number of bytes */
+    int pixel_bytes;
+};
+
+#if defined(USE_XSHM)
+/* Set when attaching a shared memory segment fails */
+static Bool shm_failed;
+
+/* Notices errors while attaching a shared memory segment */
+static int
+shm_error_handler(Display *display, XErrorEvent *event)
+{
+    shm_failed = True;
+    return 0;
+}
+
+/* Creates a frame in shared memory */
+static XImage *
+scroller_image_create_shared(scroller_image_t self,
+                             Display *display,
+                             Visual *visual,
+                             int depth,
+                             int index,
+                             unsigned int width,
+                             unsigned int height)
+{
+    XShmSegmentInfo *segment = &self->segments[index];
+    int (*handler)(Display *, XErrorEvent *);
+    XImage *frame;
+
+    frame = XShmCreateImage(display, visual, depth, ZPixmap, NULL, segment,
+                            width, height);
+    if (frame == NULL) {
+        return NULL;
+    }
+
+    /* Allocate the segment */
+    segment->shmid = shmget(IPC_PRIVATE, frame->bytes_per_line * height,
+                            IPC_CREAT | 0600);
+    if (segment->shmid < 0) {
+        XDestroyImage(frame);
+        return NULL;
+    }
+
+    segment->shmaddr = frame->data = shmat(segment->shmid, NULL, 0);
+    segment->readOnly = False;
+
+    /* Ask the server to attach it.  This fails for remote displays. */
+    shm_failed = False;
+    handler = XSetErrorHandler(shm_error_handler);
+    if (segment->shmaddr != (char *)-1) {
+        XShmAttach(display, segment);
+    } else {
+        shm_failed = True;
+    }
+
+    XSync(display, False);
+    XSetErrorHandler(handler);
+
+    /* The segment will go away once everyone has detached */
+    shmctl(segment->shmid, IPC_RMID, NULL);
+
+    if (shm_failed) {
+        if (segment->shmaddr != (char *)-1) {
+            shmdt(segment->shmaddr);
+        }
+
+        frame->data = NULL;
+        XDestroyImage(frame);
+        return NULL;
+    }
+
+    return frame;
+}
+#endif /* USE_XSHM */
+
+/* Releases the client-side rendering */
+static void
+scroller_image_free(Display *display, scroller_image_t self)
+{
+    int i;
+
+    for (i = 0; i < self->frame_count; i++) {
+#if defined(USE_XSHM)
+        if (self->is_shared) {
+            XShmDetach(display, &self->segments[i]);
+            shmdt(self->segments[i].shmaddr);
+            self->frames[i]->data = NULL;
+        }
+#endif /* USE_XSHM */
+
+        XDestroyImage(self->frames[i]);
+    }
+
+    free(self);
+}
+
+/* Allocates a client-side rendering of the scroller, using shared
+ * memory if the server supports it */
+static scroller_image_t
+scroller_image_alloc(ScrollerWidget widget)
+{
+    Display *display = XtDisplay((Widget)widget);
+    unsigned int width = widget->core.width;
+    unsigned int height = widget->scroller.height;
+    XWindowAttributes attributes;
+    scroller_image_t self;
+    XImage *frame;
+
+    /* Find out which visual we're using */
+    if (!XGetWindowAttributes(display, XtWindow((Widget)widget),
+                              &attributes)) {
+        return NULL;
+    }
+
+    self = malloc(sizeof(struct scroller_image));
+    if (self == NULL) {
+        return NULL;
+    }
+
+    memset(self, 0, sizeof(struct scroller_image));
+
+#if defined(USE_XSHM)
+    /* Try shared memory first */
+    if (XShmQueryExtension(display)) {
+        self->is_shared = True;
+        while (self->frame_count < 2) {
+            frame = scroller_image_create_shared(
+                self, display, attributes.visual, widget->core.depth,
+                self->frame_count, width, height);
+            if (frame == NULL) {
+                break;
+            }
+
+            self->frames[self->frame_count++] = frame;
+        }
+
+        if (self->frame_count == 2) {
+            goto done;
+        }
+
+        /* Give up on shared memory */
+        scroller_image_free(display, self);
+        self = malloc(sizeof(struct scroller_image));
+        if (self == NULL) {
+            return NULL;
+        }
+
+        memset(self, 0, sizeof(struct scroller_image));
+    }
+#endif /* USE_XSHM */
+
+    /* Otherwise use a single frame in ordinary memory */
+    frame = XCreateImage(display, attributes.visual, widget->core.depth,
+                         ZPixmap, 0, NULL, width, height,
+                         BitmapPad(display), 0);
+    if (frame == NULL) {
+        free(self);
+        return NULL;
+    }
+
+    frame->data = malloc(frame->bytes_per_line * height);
+    if (frame->data == NULL) {
+        XDestroyImage(frame);
+        free(self);
+        return NULL;
+    }
+
+    self->frames[0] = frame;
+    self->frame_count = 1;
+
+#if defined(USE_XSHM)
+done:
+#endif /* USE_XSHM */
+    frame = self->frames[0];
+    self->pixel_bytes = frame->bits_per_pixel % 8 == 0 ?
+                        frame->bits_per_pixel / 8 : 0;
+    DPRINTF((1, "image backend: %d %s frame(s), %d bits per pixel\n",
+             self->frame_count, self->is_shared ? "shared" : "local",
+             frame->bits_per_pixel));
+    return self;
+}
+
+/* Copies columns of pixels from one image into another */
+static void
+image_copy(XImage *dest,
+           int dest_x,
+           XImage *source,
+           int source_x,
+           int width,
+           int pixel_bytes)
+{
+    int height = MIN(dest->height, source->height);
+    int x, y;
+
+    /* Whole bytes make this easy */
+    if (pixel_bytes != 0) {
+        for (y = 0; y < height; y++) {
+            memmove(dest->data + y * dest->bytes_per_line +
+                    dest_x * pixel_bytes,
+                    source->data + y * source->bytes_per_line +
+                    source_x * pixel_bytes,
+                    width * pixel_bytes);
+        }
+
+        return;
+    }
+
+    /* Otherwise go pixel by pixel, watching for overlap */
+    for (y = 0; y < height; y++) {
+        if (dest == source && source_x < dest_x) {
+            for (x = width - 1; x >= 0; x--) {
+                XPutPixel(dest, dest_x + x, y,
+                          XGetPixel(source, source_x + x, y));
+            }
+        } else {
+            for (x = 0; x < width; x++) {
+                XPutPixel(dest, dest_x + x, y,
+                          XGetPixel(source, source_x + x, y));
+            }
+        }
+    }
+}
+
+/* Fills columns of an image with a single pixel value */
+static void
+image_fill(XImage *dest, int dest_x, int width, Pixel pixel, int pixel_bytes)
+{
+    int x, y;
+
+    /* Fill the first row */
+    for (x = 0; x < width; x++) {
+        XPutPixel(dest, dest_x + x, 0, pixel);
+    }
+
+    /* Then copy it to the others */
+    for (y = 1; y < dest->height; y++) {
+        if (pixel_bytes != 0) {
+            memcpy(dest->data + y * dest->bytes_per_line +
+                   dest_x * pixel_bytes,
+                   dest->data + dest_x * pixel_bytes,
+                   width * pixel_bytes);
+        } else {
+            for (x = 0; x < width; x++) {
+                XPutPixel(dest, dest_x + x, y, pixel);
+            }
+        }
+    }
+}
+
+/* Composes the columns from left to right of a glyph whose origin is
+ * at x into the current frame */
+static void
+image_paint_glyph(ScrollerWidget self,
+                  glyph_t glyph,
+                  int x,
+                  int left,
+                  int right)
+{
+    scroller_image_t image = self->scroller.image;
+    XImage *frame = image->frames[image->current];
+    Display *display = XtDisplay((Widget)self);
+    XImage *source;
+    XRectangle bbox;
+    int start, end;
+
+    /* The gap is just background */
+    if (glyph->message_view == NULL) {
+        image_fill(frame, left, right - left, self->core.background_pixel,
+                   image->pixel_bytes);
+        return;
+    }
+
+    /* Copy from the glyph's image if it has one */
+    source = glyph_get_image(glyph);
+    if (source != NULL) {
+        start = MAX(left, x);
+        end = MIN(right, x + source->width);
+        if (left < start) {
+            image_fill(frame, left, start - left,
+                       self->core.background_pixel, image->pixel_bytes);
+        }
+
+        if (start < end) {
+            image_copy(frame, start, source, start - x, end - start,
+                       image->pixel_bytes);
+        }
+
+        if (end < right) {
+            image_fill(frame, end, right - end,
+                       self->core.background_pixel, image->pixel_bytes);
+        }
+
+        return;
+    }
+
+    /* Otherwise render just these columns in the scratch pixmap */
+    bbox.x = 0;
+    bbox.y = 0;
+    bbox.width = right - left;
+    bbox.height = self->scroller.height;
+    XFillRectangle(display, self->scroller.pixmap,
+                   self->scroller.backgroundGC,
+                   0, 0, bbox.width, bbox.height);
+    glyph_paint(display, self->scroller.pixmap, self->scroller.gc, glyph,
+                x - left, utf8_renderer_ascent(self->scroller.renderer),
+                &bbox);
+
+    source = XGetImage(display, self->scroller.pixmap, 0, 0,
+                       bbox.width, bbox.height, AllPlanes, ZPixmap);
+    if (source == NULL) {
+        image_fill(frame, left, right - left, self->core.background_pixel,
+                   image->pixel_bytes);
+        return;
+    }
+
+    image_copy(frame, left, source, 0, right - left, image->pixel_bytes);
+    XDestroyImage(source);
+}
+
+/* Composes the columns of the current frame starting at x */
+static void
+image_paint(ScrollerWidget self, int x, unsigned int width)
+{
+    scroller_image_t image = self->scroller.image;
+    glyph_holder_t holder = self->scroller.left_holder;
+    int offset = 0 - self->scroller.left_offset;
+    int end = MIN(x + (int)width, image->frames[image->current]->width);
+    int left, right;
+
+    x = MAX(x, 0);
+    while (holder != NULL && offset < end) {
+        left = MAX(x, offset);
+        right = MIN(end, offset + holder->width);
+        if (left < right) {
+            image_paint_glyph(self, holder->glyph, offset, left, right);
+        }
+
+        offset += holder->width;
+        holder = holder->next;
+    }
+}
+
+/* Shifts the frame delta pixels to the right, moving on to the next
+ * frame if there is one */
+static void
+image_scroll(ScrollerWidget self, int delta)
+{
+    scroller_image_t image = self->scroller.image;
+    XImage *source = image->frames[image->current];
+    int next = (image->current + 1) % image->frame_count;
+    int width = source->width - (delta < 0 ? -delta : delta);
+
+    if (width > 0) {
+        image_copy(image->frames[next], MAX(delta, 0),
+                   source, MAX(-delta, 0), width, image->pixel_bytes);
+    }
+
+    image->current = next;
+}
+
+/* Sends the columns of the current frame from x to x + width to the
+ * server */
+static void
+image_present(ScrollerWidget self, int x, unsigned int width)
+{
+    scroller_image_t image = self->scroller.image;
+    XImage *frame = image->frames[image->current];
+
+#if defined(USE_XSHM)
+    if (image->is_shared) {
+        XShmPutImage(XtDisplay((Widget)self), XtWindow((Widget)self),
+                     self->scroller.backgroundGC, frame,
+                     x, 0, x, 0, width, frame->height, False);
+        return;
+    }
+#endif /* USE_XSHM */
+
+    XPutImage(XtDisplay((Widget)self), XtWindow((Widget)self),
+              self->scroller.backgroundGC, frame,
+              x, 0, x, 0, width, frame->height);
+}
+
+/* Returns non-zero if the scroller is drawn off-screen and copied
+ * onto the window by redisplay() */
+static int
+is_buffered(ScrollerWidget self)
+{
+    return self->scroller.use_pixmap || self->scroller.image != NULL;
+}
+
 /*
  * Private Methods
  */
@@ -810,6 +1696,10 @@ static void
 set_clock(ScrollerWidget self);
 static void
 tick(XtPointer widget, XtIntervalId *interval);
+static void
+fade_wheel_advance(ScrollerWidget self);
+static void
+fade_tick(XtPointer widget, XtIntervalId *interval);
 
 
 /* Answers a GC with the right background color and font */
@@ -826,6 +1716,13 @@ create_gc(ScrollerWidget self)
             self), GCFont | GCBackground | GCForeground, &values);
     self->scroller.gc = XCreateGC(
         XtDisplay(self), XtWindow(self), GCFont | GCBackground, &values);
+
+    /* Copying a pixmap into the window mustn't generate NoExpose
+     * events or we'll think we've been obscured */
+    values.graphics_exposures = False;
+    self->scroller.glyphGC = XCreateGC(
+        XtDisplay(self), XtWindow(self),
+        GCFont | GCBackground | GCGraphicsExposures, &values);
 }
 
 /* Answers an array of colors fading from first to last */
@@ -861,33 +1758,291 @@ create_faded_colors(Display *display,
 static void
 enable_clock(ScrollerWidget self)
 {
-    if (self->scroller.timer == 0 && self->scroller.step != 0) {
-        DPRINTF((1, "clock enabled\n"));
-        set_clock(self);
-    }
+    if (self->scroller.timer == 0 && self->scroller.step != 0) {
+        /* Don't try to make up for the time we were stopped */
+        self->scroller.last_frame = current_time();
+        self->scroller.next_frame = self->scroller.last_frame;
+        self->scroller.owed = 0.0;
+
+        /* Leave the timer off until we can be seen again */
+        if (self->scroller.is_hidden) {
+            DPRINTF((1, "clock enabled while hidden\n"));
+            return;
+        }
+
+        DPRINTF((1, "clock enabled\n"));
+        set_clock(self);
+        fade_wheel_set_clock(self);
+    }
+}
+
+/* Temporarily disables the timer */
+static void
+disable_clock(ScrollerWidget self)
+{
+    if (self->scroller.timer != None) {
+        DPRINTF((1, "clock disabled\n"));
+        XtRemoveTimeOut(self->scroller.timer);
+        self->scroller.timer = None;
+        fade_wheel_set_clock(self);
+    }
+}
+
+/* Makes sure that the fade wheel will be advanced when the next
+ * glyph is due to fade.  The scroll timer takes care of this when
+ * it's running; otherwise we set a timer of our own. */
+static void
+fade_wheel_set_clock(ScrollerWidget self)
+{
+    unsigned long now;
+    unsigned long next;
+    int slot;
+    int i;
+
+    /* Cancel any existing timer */
+    if (self->scroller.fade_timer != None) {
+        XtRemoveTimeOut(self->scroller.fade_timer);
+        self->scroller.fade_timer = None;
+    }
+
+    /* Don't bother if the scroll timer will do it, if there's nothing
+     * waiting to fade or if nobody would see it.  We catch up when
+     * the scroller is revealed. */
+    if (self->scroller.timer != None || self->scroller.fade_count == 0 ||
+        self->scroller.is_hidden) {
+        return;
+    }
+
+    /* Find the next occupied slot or the next cascade, whichever
+     * comes first */
+    for (i = 0; i < FADE_WHEEL_SLOTS; i++) {
+        slot = (self->scroller.fade_time + i) & FADE_WHEEL_MASK;
+        if (self->scroller.fade_wheel[0][slot] != NULL || slot == 0) {
+            break;
+        }
+    }
+
+    /* Wake up when that tick arrives */
+    next = self->scroller.fade_time + i;
+    now = fade_wheel_now();
+    self->scroller.fade_timer = XtAppAddTimeOut(
+        XtWidgetToApplicationContext((Widget)self),
+        (long)(next - now) > 0 ? (next - now) * FADE_WHEEL_RESOLUTION : 1,
+        fade_tick, self);
+}
+
+/* Moves the glyphs in a fade wheel slot down to the finer levels */
+static void
+fade_wheel_cascade(ScrollerWidget self, int level, int slot)
+{
+    glyph_t glyph = self->scroller.fade_wheel[level][slot];
+    glyph_t next;
+
+    self->scroller.fade_wheel[level][slot] = NULL;
+    while (glyph != NULL) {
+        next = glyph->wheel_next;
+        fade_wheel_link(self, glyph);
+        glyph = next;
+    }
+}
+
+/* Repaints all of the visible glyphs which have faded */
+static void
+repaint_faded(ScrollerWidget self)
+{
+    Display *display = XtDisplay((Widget)self);
+    glyph_holder_t holder;
+    int offset = 0 - self->scroller.left_offset;
+    XGCValues values;
+    XRectangle bbox;
+
+    /* Bail if there's nothing to do */
+    if (!self->scroller.fade_dirty) {
+        return;
+    }
+
+    self->scroller.fade_dirty = False;
+    if (!XtIsRealized((Widget)self) || self->scroller.is_hidden) {
+        return;
+    }
+
+    /* Construct a clipping rectangle */
+    bbox.x = 0;
+    bbox.y = 0;
+    bbox.width = self->core.width;
+    bbox.height = self->core.height;
+
+    /* No clip mask for the scroller */
+    values.clip_mask = None;
+    XChangeGC(display, self->scroller.gc, GCClipMask, &values);
+    self->scroller.clip_width = 0;
+
+    /* Paint every visible glyph which has faded */
+    for (holder = self->scroller.left_holder;
+         holder != NULL;
+         holder = holder->next) {
+        if (holder->glyph->needs_repaint) {
+            if (self->scroller.image != NULL) {
+                paint(self, offset, 0, holder->width, self->scroller.height);
+            } else {
+                glyph_holder_paint(
+                    display,
+                    self->scroller.use_pixmap ?
+                    self->scroller.pixmap : XtWindow((Widget)self),
+                    self->scroller.gc,
+                    holder, offset,
+                    utf8_renderer_ascent(self->scroller.renderer), &bbox);
+            }
+
+            if (is_buffered(self)) {
+                add_damage(self, offset, holder->width);
+            }
+        }
+
+        offset += holder->width;
+    }
+
+    /* Clear the flags now that a glyph's holders have all been painted */
+    for (holder = self->scroller.left_holder;
+         holder != NULL;
+         holder = holder->next) {
+        holder->glyph->needs_repaint = False;
+    }
+}
+
+/* Fades every glyph whose deadline has passed */
+static void
+fade_wheel_advance(ScrollerWidget self)
+{
+    unsigned long now = fade_wheel_now();
+    glyph_t glyph;
+    int level;
+    int slot;
+
+    while ((long)(now - self->scroller.fade_time) >= 0) {
+        /* Skip straight to the present if the wheel is empty */
+        if (self->scroller.fade_count == 0) {
+            self->scroller.fade_time = now + 1;
+            break;
+        }
+
+        /* Cascade the coarser levels each time a finer one wraps */
+        slot = self->scroller.fade_time & FADE_WHEEL_MASK;
+        for (level = 1; slot == 0 && level < FADE_WHEEL_LEVELS; level++) {
+            slot = (self->scroller.fade_time >> (level * FADE_WHEEL_BITS)) &
+                   FADE_WHEEL_MASK;
+            fade_wheel_cascade(self, level, slot);
+        }
+
+        /* Detach the glyphs which are due so that any rescheduled
+         * for exactly one revolution from now aren't seen again */
+        slot = self->scroller.fade_time & FADE_WHEEL_MASK;
+        ASSERT(self->scroller.fade_due == NULL);
+        self->scroller.fade_due = self->scroller.fade_wheel[0][slot];
+        self->scroller.fade_wheel[0][slot] = NULL;
+        for (glyph = self->scroller.fade_due;
+             glyph != NULL;
+             glyph = glyph->wheel_next) {
+            glyph->wheel_level = FADE_DUE;
+        }
+
+        self->scroller.fade_time++;
+
+        /* Fade them.  This may free other glyphs in the list, so
+         * always take the glyph from the head. */
+        while ((glyph = self->scroller.fade_due) != NULL) {
+            glyph_clear_clock(glyph);
+            glyph_tick(glyph);
+        }
+    }
+
+    /* Repaint everything which faded in one pass */
+    repaint_faded(self);
+    fade_wheel_set_clock(self);
+}
+
+/* The fade timer has gone off */
+static void
+fade_tick(XtPointer widget, XtIntervalId *interval)
+{
+    ScrollerWidget self = (ScrollerWidget)widget;
+
+    /* Clear the timer so that fade_wheel_set_clock() can set it again */
+    ASSERT(*interval == self->scroller.fade_timer);
+    self->scroller.fade_timer = None;
+
+    fade_wheel_advance(self);
+    flush_damage(self);
 }
 
-/* Temporarily disables the timer */
+/* Sets the timer for the next frame if the clock isn't stopped */
 static void
-disable_clock(ScrollerWidget self)
+set_clock(ScrollerWidget self)
 {
+    double period = 1.0 / self->scroller.frequency;
+    double now;
+    long delay;
+
     if (self->scroller.timer != None) {
-        DPRINTF((1, "clock disabled\n"));
-        XtRemoveTimeOut(self->scroller.timer);
-        self->scroller.timer = None;
+        return;
+    }
+
+    /* Aim for the next frame boundary so that rounding the delay to
+     * whole milliseconds doesn't accumulate.  If we've fallen behind
+     * then start again from now; tick() makes up the distance. */
+    now = current_time();
+    self->scroller.next_frame += period;
+    if (self->scroller.next_frame < now) {
+        self->scroller.next_frame = now + period;
     }
+
+    delay = (long)((self->scroller.next_frame - now) * 1000.0 + 0.5);
+    self->scroller.timer = XtAppAddTimeOut(
+        XtWidgetToApplicationContext((Widget)self),
+        MAX(delay, 1), tick, self);
 }
 
-/* Sets the timer if the clock isn't stopped */
+/* Works out how much faster than the step size we need to scroll in
+ * order to show every queued message before it expires */
 static void
-set_clock(ScrollerWidget self)
+adapt_speed(ScrollerWidget self, double now)
 {
-    if (self->scroller.timer == None) {
-        self->scroller.timer = XtAppAddTimeOut(
-            XtWidgetToApplicationContext((Widget)self),
-            1000L / self->scroller.frequency,
-            tick, self);
+    double speed = abs(self->scroller.step) * self->scroller.frequency;
+    double needed = 0.0;
+    double distance;
+    double remaining;
+    glyph_t glyph;
+
+    self->scroller.next_adapt = now + ADAPT_INTERVAL;
+
+    /* Start with the glyphs which will scroll on next and walk the
+     * queue until we reach the gap; everything beyond it has already
+     * been shown at least once */
+    if (self->scroller.step > 0) {
+        distance = self->scroller.right_offset;
+        glyph = glyph_get_successor(self->scroller.right_holder->glyph)->next;
+    } else {
+        distance = self->scroller.left_offset;
+        glyph = glyph_get_successor(self->scroller.left_holder->glyph)->previous;
     }
+
+    while (glyph != self->scroller.gap) {
+        /* Expired glyphs are skipped when scrolling on */
+        if (!glyph->is_expired) {
+            distance += glyph_get_width(glyph);
+
+            /* How fast must we go to show all of this glyph in time? */
+            remaining = MAX(glyph->expiry - now, 1.0);
+            needed = MAX(needed, distance / remaining);
+        }
+
+        glyph = self->scroller.step > 0 ? glyph->next : glyph->previous;
+    }
+
+    /* Never go slower than the step size or faster than the limit */
+    self->scroller.speed_factor = speed == 0.0 ? 1.0 :
+        MIN(MAX(needed / speed, 1.0), MAX_SPEED_FACTOR);
+    DPRINTF((2, "adaptive speed factor %f\n", self->scroller.speed_factor));
 }
 
 /* One interval has passed */
@@ -895,6 +2050,9 @@ static void
 tick(XtPointer widget, XtIntervalId *interval)
 {
     ScrollerWidget self = (ScrollerWidget)widget;
+    double now;
+    double elapsed;
+    int pixels;
 
     /* Clear the timer so that set_clock() can set it again */
     ASSERT(*interval == self->scroller.timer);
@@ -903,10 +2061,46 @@ tick(XtPointer widget, XtIntervalId *interval)
     /* Set the clock now so that we get consistent scrolling speed */
     set_clock(self);
 
+    /* Work out how far we should have scrolled since the last frame.
+     * Carry any fraction of a pixel over to the next one, but don't
+     * try to make up for a really long stall. */
+    now = current_time();
+    elapsed = MIN(now - self->scroller.last_frame, MAX_FRAME_INTERVAL);
+    self->scroller.last_frame = now;
+
+    /* Speed up if the backlog requires it */
+    if (self->scroller.adaptive_speed) {
+        if (self->scroller.next_adapt <= now) {
+            adapt_speed(self, now);
+        }
+    } else {
+        self->scroller.speed_factor = 1.0;
+    }
+
+    if (elapsed > 0.0) {
+        self->scroller.owed += elapsed * self->scroller.step *
+                               self->scroller.frequency *
+                               self->scroller.speed_factor;
+    }
+
+    pixels = (int)self->scroller.owed;
+    self->scroller.owed -= pixels;
+
     /* Don't scroll if we're in the midst of a drag or if the scroller
      * is stopped */
     ASSERT(self->scroller.step != 0);
-    scroll(self, self->scroller.step);
+    scroll(self, pixels);
+
+    /* Fade any glyphs which are due */
+    fade_wheel_advance(self);
+
+    /* Send the whole frame to the server at once */
+    flush_damage(self);
+
+    /* Record how long the frame took */
+    elapsed = (current_time() - now) * 1e6 / SC_FRAME_BUCKET_USEC;
+    self->scroller.frame_times[MIN((long)elapsed, SC_FRAME_BUCKETS - 1)]++;
+    self->scroller.frame_count++;
 }
 
 /* Returns the tail of the queue */
@@ -946,6 +2140,11 @@ ScRepaintGlyph(ScrollerWidget self, glyph_t glyph)
     XGCValues values;
     XRectangle bbox;
 
+    /* Don't paint what can't be seen */
+    if (self->scroller.is_hidden) {
+        return;
+    }
+
     /* Construct a clipping rectangle */
     bbox.x = 0;
     bbox.y = 0;
@@ -960,21 +2159,32 @@ ScRepaintGlyph(ScrollerWidget self, glyph_t glyph)
     /* Go through the visible glyphs looking for the one to paint */
     while (holder != NULL) {
         if (holder->glyph == glyph) {
-            if (self->scroller.use_pixmap) {
+            if (self->scroller.image != NULL) {
+                paint(self, offset, 0, holder->width, self->scroller.height);
+                add_damage(self, offset, holder->width);
+            } else if (self->scroller.use_pixmap) {
                 glyph_holder_paint(
                     display, self->scroller.pixmap, self->scroller.gc,
-                    holder, offset, self->scroller.font->ascent, &bbox);
-                redisplay(self, NULL);
+                    holder, offset,
+                    utf8_renderer_ascent(self->scroller.renderer), &bbox);
+                add_damage(self, offset, holder->width);
             } else {
                 glyph_holder_paint(
                     display, XtWindow((Widget)self), self->scroller.gc,
-                    holder, offset, self->scroller.font->ascent, &bbox);
+                    holder, offset,
+                    utf8_renderer_ascent(self->scroller.renderer), &bbox);
             }
         }
 
         offset += holder->width;
         holder = holder->next;
     }
+
+    /* Nothing else will copy the damage onto the window if the clock
+     * isn't running */
+    if (self->scroller.timer == None) {
+        flush_damage(self);
+    }
 }
 
 /*
@@ -1027,12 +2237,24 @@ static void
 initialize(Widget request, Widget widget, ArgList args, Cardinal *num_args)
 {
     ScrollerWidget self = (ScrollerWidget)widget;
+    struct string_sizes sizes;
     glyph_holder_t holder;
 
-    /* Try to allocate a conversion descriptor */
-    self->scroller.renderer = utf8_renderer_alloc(XtDisplay(widget),
-                                                  self->scroller.font,
-                                                  self->scroller.code_set);
+    /* Use the scalable font if one was named and it can be opened */
+    self->scroller.renderer = NULL;
+    if (self->scroller.xft_font != NULL) {
+        self->scroller.renderer = utf8_renderer_alloc_xft(
+            XtDisplay(widget), XtScreen(widget), self->core.colormap,
+            self->scroller.xft_font);
+    }
+
+    /* Otherwise try to allocate a conversion descriptor */
+    if (self->scroller.renderer == NULL) {
+        self->scroller.renderer = utf8_renderer_alloc(
+            XtDisplay(widget), self->scroller.font, self->scroller.code_set);
+        self->scroller.xft_font = NULL;
+    }
+
     if (self->scroller.renderer == NULL) {
         /* FIX THIS: can we fail gracefully? */
         perror("trouble");
@@ -1040,8 +2262,9 @@ initialize(Widget request, Widget widget, ArgList args, Cardinal *num_args)
     }
 
     /* Record the height and width for future reference */
-    self->scroller.height = self->scroller.font->ascent +
-                            self->scroller.font->descent;
+    self->scroller.height =
+        utf8_renderer_ascent(self->scroller.renderer) +
+        utf8_renderer_descent(self->scroller.renderer);
 
     /* Set the default dimensions of the widget.  These will be
      * overridden later when the widget is realized. */
@@ -1049,13 +2272,47 @@ initialize(Widget request, Widget widget, ArgList args, Cardinal *num_args)
     self->core.height = self->scroller.height;
 
     /* Record the width of 8 'n' characters as the minimum gap width */
-    self->scroller.min_gap_width = compute_min_gap_width(self->scroller.font);
+    if (self->scroller.xft_font == NULL) {
+        self->scroller.min_gap_width =
+            compute_min_gap_width(self->scroller.font);
+    } else {
+        utf8_renderer_measure_string(self->scroller.renderer, "n", &sizes);
+        self->scroller.min_gap_width = 3 * sizes.width;
+    }
 
     /* Make sure we have a height */
     if (self->core.height == 0) {
         self->core.height = self->scroller.height;
     }
 
+    /* Prepare to allocate glyphs and holders */
+    pool_init(&self->scroller.glyph_pool, sizeof(struct glyph));
+    pool_init(&self->scroller.holder_pool, sizeof(struct glyph_holder));
+
+    /* Index the queue's glyphs by tag */
+    self->scroller.tags = hash_table_alloc();
+    if (self->scroller.tags == NULL) {
+        /* FIX THIS: can we fail gracefully? */
+        perror("trouble");
+        exit(1);
+    }
+
+    /* No frames yet */
+    self->scroller.frame_count = 0;
+    memset(self->scroller.frame_times, 0, sizeof(self->scroller.frame_times));
+
+    /* Scroll at the baseline speed until we know better */
+    self->scroller.speed_factor = 1.0;
+    self->scroller.next_adapt = 0.0;
+
+    /* Start with an empty fade wheel */
+    memset(self->scroller.fade_wheel, 0, sizeof(self->scroller.fade_wheel));
+    self->scroller.fade_timer = None;
+    self->scroller.fade_due = NULL;
+    self->scroller.fade_time = fade_wheel_now();
+    self->scroller.fade_count = 0;
+    self->scroller.fade_dirty = False;
+
     /* Allocate a glyph to represent the gap */
     self->scroller.gap = glyph_alloc(self, NULL);
     GLYPH_ALLOC_REF(self->scroller.gap, ref_gap, self);
@@ -1068,7 +2325,12 @@ initialize(Widget request, Widget widget, ArgList args, Cardinal *num_args)
     /* Initialize the queue to only contain the gap with 0 offsets */
     self->scroller.timer = 0;
     self->scroller.is_stopped = True;
+    self->scroller.damage = XCreateRegion();
     self->scroller.is_visible = False;
+    self->scroller.is_obscured = False;
+    self->scroller.is_unmapped = False;
+    self->scroller.is_hidden = False;
+    self->scroller.shell = NULL;
     self->scroller.is_dragging = False;
     self->scroller.left_holder = holder;
     self->scroller.right_holder = holder;
@@ -1084,6 +2346,7 @@ initialize(Widget request, Widget widget, ArgList args, Cardinal *num_args)
 
     self->scroller.copy_message = NULL;
     self->scroller.copy_part = MSGPART_NONE;
+    self->scroller.image = NULL;
 }
 
 /* Realize the widget by creating a window in which to display it */
@@ -1110,7 +2373,12 @@ realize(Widget widget,
                    attributes);
     create_gc(self);
 
-    if (self->scroller.use_pixmap) {
+    /* Try to set up the image backend if it was requested */
+    if (self->scroller.use_image) {
+        self->scroller.image = scroller_image_alloc(self);
+    }
+
+    if (is_buffered(self)) {
         /* Create an offscreen pixmap */
         self->scroller.pixmap = XCreatePixmap(
             XtDisplay(self), XtWindow(self),
@@ -1124,6 +2392,21 @@ realize(Widget widget,
         XtAddEventHandler(widget, 0, True, gexpose, NULL);
     }
 
+    /* Watch for the scroller being covered or unmapped.  Iconifying
+     * the shell doesn't send us a VisibilityNotify event, so watch
+     * the shell's mapping too. */
+    XtAddEventHandler(widget, VisibilityChangeMask | StructureNotifyMask,
+                      False, visibility, self);
+    self->scroller.shell = XtParent(widget);
+    while (self->scroller.shell != NULL && !XtIsShell(self->scroller.shell)) {
+        self->scroller.shell = XtParent(self->scroller.shell);
+    }
+
+    if (self->scroller.shell != NULL) {
+        XtAddEventHandler(self->scroller.shell, StructureNotifyMask,
+                          False, visibility, self);
+    }
+
     /* Avoid pathological numbers of fade levels. */
     if (self -> scroller.fade_levels < 1)
     {
@@ -1250,28 +2533,6 @@ remove_right_holder(ScrollerWidget self)
     glyph_holder_free(holder);
 }
 
-/* Find a holder whose glyph has the given tag. */
-static glyph_holder_t
-find_holder(ScrollerWidget self, const char *tag)
-{
-    glyph_holder_t probe;
-    const char *probe_tag;
-
-    /* This should never be called with a NULL tag. */
-    ASSERT(tag != NULL);
-
-    /* Walk the list of glyph holders looking for a match. */
-    probe = self->scroller.left_holder;
-    for (; probe != NULL; probe = probe->next) {
-        probe_tag = glyph_holder_get_tag(probe);
-        if (probe_tag != NULL && strcmp(probe_tag, tag) == 0) {
-            return probe;
-        }
-    }
-
-    return NULL;
-}
-
 /* Updates the state of the scroller after a shift of zero or more
  * pixels to the left. */
 static void
@@ -1350,6 +2611,163 @@ adjust_right(ScrollerWidget self)
     }
 }
 
+/* Moves the glyph holders delta pixels to the right without
+ * painting anything */
+static void
+shift(ScrollerWidget self, int delta)
+{
+    self->scroller.left_offset -= delta;
+    self->scroller.right_offset += delta;
+
+    /* Update the view holders */
+    if (delta < 0) {
+        adjust_left(self);
+    } else {
+        adjust_right(self);
+    }
+}
+
+/* Returns the distance the scroller travels before the unexpired
+ * glyphs in the queue come around again */
+static long
+queue_cycle_width(ScrollerWidget self)
+{
+    glyph_t glyph;
+    long width = 0;
+    int last_width = self->core.width;
+
+    for (glyph = self->scroller.gap->next;
+         glyph != self->scroller.gap;
+         glyph = glyph->next) {
+        if (!glyph->is_expired) {
+            last_width = glyph_get_width(glyph);
+            width += last_width;
+        }
+    }
+
+    return width + gap_width(self, last_width);
+}
+
+/* Moves the scroller to where it would have been if it had kept
+ * scrolling while it was hidden */
+static void
+catch_up(ScrollerWidget self)
+{
+    double now = current_time();
+    double distance;
+    long cycle;
+    long pixels;
+
+    /* Work out how far we would have scrolled */
+    distance = self->scroller.owed + (now - self->scroller.last_frame) *
+               self->scroller.step * self->scroller.frequency *
+               self->scroller.speed_factor;
+    self->scroller.last_frame = now;
+    self->scroller.next_frame = now;
+
+    /* Going all of the way around the queue gets us back where we
+     * started, so only travel the remainder */
+    pixels = (long)distance;
+    self->scroller.owed = distance - pixels;
+    cycle = queue_cycle_width(self);
+    if (cycle > 0) {
+        pixels %= cycle;
+    }
+
+    DPRINTF((1, "catching up %ld pixels\n", pixels));
+    shift(self, (int)-pixels);
+}
+
+/* Repaints the whole scroller */
+static void
+repaint_all(ScrollerWidget self)
+{
+    if (is_buffered(self)) {
+        paint(self, 0, 0, self->core.width, self->scroller.height);
+        redisplay(self, NULL);
+    } else {
+        XFillRectangle(XtDisplay((Widget)self), XtWindow((Widget)self),
+                       self->scroller.backgroundGC,
+                       0, 0, self->core.width, self->scroller.height);
+        paint(self, 0, 0, self->core.width, self->scroller.height);
+    }
+}
+
+/* Stops or restarts all of the scroller's work when it's hidden or
+ * revealed */
+static void
+set_hidden(ScrollerWidget self, Bool is_hidden)
+{
+    Display *display = XtDisplay((Widget)self);
+
+    if (self->scroller.is_hidden == is_hidden) {
+        return;
+    }
+
+    /* Stop both clocks, leaving last_frame as a record of how far
+     * we got */
+    if (is_hidden) {
+        DPRINTF((1, "scroller hidden\n"));
+        self->scroller.is_hidden = True;
+        if (self->scroller.timer != None) {
+            XtRemoveTimeOut(self->scroller.timer);
+            self->scroller.timer = None;
+        }
+
+        fade_wheel_set_clock(self);
+        return;
+    }
+
+    /* Fade everything that should have faded while we were hidden
+     * before letting the repaints through */
+    DPRINTF((1, "scroller revealed\n"));
+    fade_wheel_advance(self);
+    self->scroller.is_hidden = False;
+
+    /* Any outstanding CopyArea has long since been processed */
+    if (LastKnownRequestProcessed(display) >= self->scroller.request_id) {
+        self->scroller.local_delta = 0;
+    }
+
+    /* Pick up where we would have been and start the clocks again */
+    if (!self->scroller.is_stopped && !self->scroller.is_dragging &&
+        self->scroller.step != 0) {
+        catch_up(self);
+        enable_clock(self);
+    }
+
+    fade_wheel_set_clock(self);
+    repaint_all(self);
+}
+
+/* Keeps track of whether or not the scroller can be seen */
+static void
+visibility(Widget widget, XtPointer rock, XEvent *event, Boolean *ignored)
+{
+    ScrollerWidget self = (ScrollerWidget)rock;
+
+    switch (event->type) {
+    case VisibilityNotify:
+        self->scroller.is_obscured =
+            event->xvisibility.state == VisibilityFullyObscured;
+        break;
+
+    case UnmapNotify:
+        self->scroller.is_unmapped = True;
+        break;
+
+    case MapNotify:
+        self->scroller.is_unmapped = False;
+        break;
+
+    default:
+        return;
+    }
+
+    set_hidden(self, self->scroller.is_obscured ||
+               self->scroller.is_unmapped);
+}
+
 /* Try to scroll to the desired position as determined by
  * target_delta.  If the X server hasn't acknowledged our last
  * CopyArea request then we leave this pending */
@@ -1374,16 +2792,25 @@ scroll(ScrollerWidget self, int offset)
     }
 
     /* Scroll left or right as appropriate */
-    self->scroller.left_offset -= delta;
-    self->scroller.right_offset += delta;
+    shift(self, delta);
     self->scroller.local_delta = delta;
     self->scroller.target_delta = 0;
 
-    /* Update the view holders */
-    if (delta < 0) {
-        adjust_left(self);
-    } else {
-        adjust_right(self);
+    /* Images are done on our side */
+    if (self->scroller.image != NULL) {
+        /* Scroll the image */
+        image_scroll(self, delta);
+
+        /* We're always in sync with the X server */
+        self->scroller.local_delta = 0;
+
+        /* Repaint the missing bits and send the frame to the server
+         * at the end of the tick */
+        paint(self,
+              delta < 0 ? self->core.width + delta : 0, 0,
+              delta < 0 ? -delta : delta, self->scroller.height);
+        add_damage(self, 0, self->core.width);
+        return;
     }
 
     /* Pixmaps are easy */
@@ -1402,8 +2829,8 @@ scroll(ScrollerWidget self, int offset)
               delta < 0 ? self->core.width + delta : 0, 0,
               delta < 0 ? -delta : delta, self->scroller.height);
 
-        /* Copy the pixmap to the screen */
-        redisplay(self, NULL);
+        /* Copy the pixmap to the screen at the end of the tick */
+        add_damage(self, 0, self->core.width);
         return;
     }
 
@@ -1441,6 +2868,12 @@ paint(ScrollerWidget self,
     XGCValues values;
     XRectangle bbox;
 
+    /* The image backend does its own thing */
+    if (self->scroller.image != NULL) {
+        image_paint(self, x, width);
+        return;
+    }
+
     /* Compensate for unprocessed CopyArea requests */
     x += self->scroller.local_delta;
 
@@ -1480,10 +2913,12 @@ paint(ScrollerWidget self,
         if (self->scroller.use_pixmap) {
             glyph_holder_paint(display, self->scroller.pixmap,
                                self->scroller.gc, holder, offset,
-                               self->scroller.font->ascent, &bbox);
+                               utf8_renderer_ascent(self->scroller.renderer),
+                               &bbox);
         } else {
             glyph_holder_paint(display, XtWindow(self), self->scroller.gc,
-                               holder, offset, self->scroller.font->ascent,
+                               holder, offset,
+                               utf8_renderer_ascent(self->scroller.renderer),
                                &bbox);
         }
 
@@ -1495,28 +2930,88 @@ paint(ScrollerWidget self,
     ASSERT(offset - self->core.width == self->scroller.right_offset);
 }
 
-/* Repaints the scroller */
+/* Repaints the portion of the scroller in the region, or all of it
+ * if the region is NULL */
 static void
 redisplay(ScrollerWidget self, Region region)
 {
+    XRectangle rectangle;
+
+    /* Find the smallest enclosing rectangle */
+    if (region != NULL) {
+        XClipBox(region, &rectangle);
+    } else {
+        rectangle.x = 0;
+        rectangle.width = self->core.width;
+    }
+
+    /* If we're using an image then send that part of it */
+    if (self->scroller.image != NULL) {
+        image_present(self, rectangle.x, rectangle.width);
+        return;
+    }
+
     /* If we're using a pixmap then just copy it to the window */
     if (self->scroller.use_pixmap) {
         XCopyArea(XtDisplay((Widget)self), self->scroller.pixmap,
                   XtWindow((Widget)self), self->scroller.backgroundGC,
-                  0, 0, self->core.width, self->scroller.height, 0, 0);
+                  rectangle.x, 0, rectangle.width, self->scroller.height,
+                  rectangle.x, 0);
         return;
     }
 
     /* Repaint the region */
     if (region != NULL) {
-        XRectangle rectangle;
-
-        /* Find the smallest enclosing rectangle and repaint within it */
-        XClipBox(region, &rectangle);
         paint(self, rectangle.x, 0, rectangle.width, self->scroller.height);
     }
 }
 
+/* Records that part of the offscreen pixmap or image needs to be
+ * copied onto the window */
+static void
+add_damage(ScrollerWidget self, int x, unsigned int width)
+{
+    XRectangle rectangle;
+
+    /* Clip to the window */
+    if (x < 0) {
+        width = (int)width + x > 0 ? width + x : 0;
+        x = 0;
+    }
+
+    if (x + width > self->core.width) {
+        width = x < self->core.width ? self->core.width - x : 0;
+    }
+
+    if (width == 0) {
+        return;
+    }
+
+    rectangle.x = x;
+    rectangle.y = 0;
+    rectangle.width = width;
+    rectangle.height = self->scroller.height;
+    XUnionRectWithRegion(&rectangle, self->scroller.damage,
+                         self->scroller.damage);
+}
+
+/* Copies everything which has changed since the last frame onto the
+ * window in a single request */
+static void
+flush_damage(ScrollerWidget self)
+{
+    if (XEmptyRegion(self->scroller.damage)) {
+        return;
+    }
+
+    if (XtIsRealized((Widget)self) && !self->scroller.is_hidden) {
+        redisplay(self, self->scroller.damage);
+    }
+
+    XSubtractRegion(self->scroller.damage, self->scroller.damage,
+                    self->scroller.damage);
+}
+
 /* Redisplay the portion of the scroller in the Region */
 static void
 expose(Widget widget, XEvent *event, Region region)
@@ -1585,7 +3080,58 @@ gexpose(Widget widget, XtPointer rock, XEvent *event, Boolean *ignored)
 static void
 destroy(Widget widget)
 {
+    ScrollerWidget self = (ScrollerWidget)widget;
+    glyph_holder_t holder;
+
     DPRINTF((2, "destroy %p\n", widget));
+
+    /* Stop the scroll timer */
+    if (self->scroller.timer != None) {
+        XtRemoveTimeOut(self->scroller.timer);
+        self->scroller.timer = None;
+    }
+
+    /* Stop the fade timer */
+    if (self->scroller.fade_timer != None) {
+        XtRemoveTimeOut(self->scroller.fade_timer);
+        self->scroller.fade_timer = None;
+    }
+
+    /* Stop watching the shell if it's staying around */
+    if (self->scroller.shell != NULL &&
+        !self->scroller.shell->core.being_destroyed) {
+        XtRemoveEventHandler(self->scroller.shell, StructureNotifyMask,
+                             False, visibility, self);
+    }
+
+    /* Free the tag index */
+    hash_table_free(self->scroller.tags);
+
+    /* And the damage region */
+    XDestroyRegion(self->scroller.damage);
+
+    /* Release the visible glyphs' renderings */
+    for (holder = self->scroller.left_holder;
+         holder != NULL;
+         holder = holder->next) {
+        glyph_release_pixmap(holder->glyph);
+    }
+
+    /* Release the client-side rendering */
+    if (self->scroller.image != NULL) {
+        scroller_image_free(XtDisplay(widget), self->scroller.image);
+        self->scroller.image = NULL;
+    }
+
+    /* Free every glyph and holder at once */
+    DPRINTF((1, "destroying %lu glyphs and %lu holders\n",
+             self->scroller.glyph_pool.count,
+             self->scroller.holder_pool.count));
+    pool_destroy(&self->scroller.glyph_pool);
+    pool_destroy(&self->scroller.holder_pool);
+
+    /* And the renderer they were drawn with */
+    utf8_renderer_free(self->scroller.renderer);
 }
 
 /* Find the empty view and update its width */
@@ -1601,7 +3147,7 @@ resize(Widget widget)
     }
 
     /* If we're using an offscreen pixmap then we'll need a new one */
-    if (self->scroller.use_pixmap) {
+    if (is_buffered(self)) {
         /* Otherwise we need a new offscreen pixmap */
         XFreePixmap(XtDisplay(widget), self->scroller.pixmap);
         self->scroller.pixmap = XCreatePixmap(
@@ -1610,10 +3156,21 @@ resize(Widget widget)
             self->core.depth);
     }
 
+    /* And a new image */
+    if (self->scroller.image != NULL) {
+        scroller_image_free(XtDisplay(widget), self->scroller.image);
+        self->scroller.image = scroller_image_alloc(self);
+
+        /* Fall back to the pixmap if that failed */
+        if (self->scroller.image == NULL) {
+            self->scroller.use_pixmap = True;
+        }
+    }
+
     /* If the scroller is stalled, then we simply need to expand the gap */
     if (self->scroller.is_stopped) {
         self->scroller.left_holder->width = self->core.width;
-        if (self->scroller.use_pixmap) {
+        if (is_buffered(self)) {
             paint(self, 0, 0, self->core.width, self->scroller.height);
             redisplay(self, NULL);
         }
@@ -1680,7 +3237,7 @@ resize(Widget widget)
         adjust_left(self);
     }
 
-    if (self->scroller.use_pixmap) {
+    if (is_buffered(self)) {
         /* Update the display on that pixmap */
         paint(self, 0, 0, self->core.width, self->scroller.height);
         redisplay(self, NULL);
@@ -2155,15 +3712,7 @@ delete_glyph(ScrollerWidget self, glyph_t glyph)
     }
 
     /* Repaint the scroller. */
-    if (self->scroller.use_pixmap) {
-        paint(self, 0, 0, self->core.width, self->scroller.height);
-        redisplay(self, NULL);
-    } else {
-        XFillRectangle(XtDisplay((Widget)self), XtWindow((Widget)self),
-                       self->scroller.backgroundGC,
-                       0, 0, self->core.width, self->scroller.height);
-        paint(self, 0, 0, self->core.width, self->scroller.height);
-    }
+    repaint_all(self);
 }
 
 /* Simply remove the message from the scroller NOW */
@@ -2335,6 +3884,7 @@ drag(Widget widget, XEvent *event, String *params, Cardinal *nparams)
 
     /* Drag the scroller to the right place */
     scroll(self, self->scroller.last_x - motion_event->x);
+    flush_damage(self);
     self->scroller.last_x = motion_event->x;
 }
 
@@ -2394,6 +3944,7 @@ ScAddMessage(Widget widget, message_t message)
     const char *tag;
     glyph_t glyph;
     glyph_t probe;
+    glyph_t visible;
     glyph_holder_t holder;
 
     /* Create a glyph for the message */
@@ -2404,21 +3955,26 @@ ScAddMessage(Widget widget, message_t message)
 
     /* See if the new message replaces another. */
     tag = message_get_tag(message);
-    probe = (tag == NULL) ? NULL : queue_find(self->scroller.gap, tag);
+    probe = queue_find(self, tag);
     if (probe == NULL) {
         /* The message doesn't match an existing one, so just append
          * it to the end. */
         queue_add(self->scroller.gap->previous, glyph);
     } else {
+        /* If the replaced glyph is still on the screen then it's
+         * either visible itself or it's the invisible successor of
+         * the visible glyph.  Find out which before the queue lets go
+         * of it. */
+        visible = probe->holder_count != 0 ? probe : probe->predecessor;
+
         /* The message replaces another.  Update the glyph queue to
          * refer to our new glyph instead of the replaced one. */
         queue_replace(probe, glyph);
 
         /* If the replaced glyph is still visible then record our new
            glyph as its successor. */
-        holder = find_holder(self, tag);
-        if (holder != NULL) {
-            glyph_set_successor(holder->glyph, glyph);
+        if (visible != NULL) {
+            glyph_set_successor(visible, glyph);
         }
     }
 
@@ -2438,6 +3994,9 @@ ScAddMessage(Widget widget, message_t message)
         }
     }
 
+    /* Reconsider the speed now that the backlog has grown */
+    self->scroller.next_adapt = 0.0;
+
     /* Make sure the clock is running */
     if (self->scroller.is_stopped) {
         self->scroller.is_stopped = False;
@@ -2445,6 +4004,23 @@ ScAddMessage(Widget widget, message_t message)
     }
 }
 
+/* Fills in stats with the receiver's current statistics */
+void
+ScGetStats(Widget widget, scroller_stats_t stats)
+{
+    ScrollerWidget self = (ScrollerWidget)widget;
+
+    stats->glyph_count = self->scroller.glyph_pool.count;
+    stats->glyph_peak = self->scroller.glyph_pool.peak;
+    stats->holder_count = self->scroller.holder_pool.count;
+    stats->holder_peak = self->scroller.holder_pool.peak;
+    stats->heap_bytes = self->scroller.glyph_pool.bytes +
+                        self->scroller.holder_pool.bytes;
+    stats->frame_count = self->scroller.frame_count;
+    memcpy(stats->frame_times, self->scroller.frame_times,
+           sizeof(stats->frame_times));
+}
+
 /* Purge any killed messages */
 void
 ScPurgeKilled(Widget widget)
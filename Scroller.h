@@ -53,6 +53,7 @@
  ----                     -----                -------                -----------
  font                     Font                XFontStruct *        XtDefaultFont
  fontCodeSet         String             String          NULL
+ xftFont             String             String          NULL
  groupPixel             GroupPixel                Pixel                Blue
  userPixel             UserPixel                Pixel                Green
  stringPixel             StringPixel        Pixel                Red
@@ -60,9 +61,12 @@
  fadeLevels             FadeLevels                Dimension        5
 
  usePixmap           UsePixmap                Boolean                False
+ cacheGlyphs         CacheGlyphs                Boolean                True
+ useImage            UseImage                Boolean                False
  dragDelta             DragDelta                Dimension        3
  frequency             Frequency                Dimension        24
  stepSize             StepSize                Position        1
+ adaptiveSpeed       AdaptiveSpeed        Boolean                False
 
  background             Background                Pixel                XtDefaultBackground
  border                     BorderColor        Pixel                XtDefaultForeground
@@ -85,6 +89,9 @@
 #ifndef XtNfontCodeSet
 # define XtNfontCodeSet "fontCodeSet"
 #endif
+#ifndef XtNxftFont
+# define XtNxftFont "xftFont"
+#endif
 #ifndef XtNattachmentCallback
 # define XtNattachmentCallback "attachmentCallback"
 #endif
@@ -127,6 +134,18 @@
 #ifndef XtCUsePixmap
 # define XtCUsePixmap "UsePixmap"
 #endif
+#ifndef XtNcacheGlyphs
+# define XtNcacheGlyphs "cacheGlyphs"
+#endif
+#ifndef XtCCacheGlyphs
+# define XtCCacheGlyphs "CacheGlyphs"
+#endif
+#ifndef XtNuseImage
+# define XtNuseImage "useImage"
+#endif
+#ifndef XtCUseImage
+# define XtCUseImage "UseImage"
+#endif
 #ifndef XtNdragDelta
 # define XtNdragDelta "dragDelta"
 #endif
@@ -145,6 +164,12 @@
 #ifndef XtCStepSize
 # define XtCStepSize "StepSize"
 #endif
+#ifndef XtNadaptiveSpeed
+# define XtNadaptiveSpeed "adaptiveSpeed"
+#endif
+#ifndef XtCAdaptiveSpeed
+# define XtCAdaptiveSpeed "AdaptiveSpeed"
+#endif
 
 typedef struct _ScrollerClassRec *ScrollerWidgetClass;
 typedef struct _ScrollerRec *ScrollerWidget;
@@ -168,4 +193,43 @@ void
 ScPurgeKilled(Widget self);
 
 
+/* The number of buckets in a Scroller's histogram of frame times */
+#define SC_FRAME_BUCKETS 1000
+
+/* The width of each bucket of the histogram in microseconds */
+#define SC_FRAME_BUCKET_USEC 10
+
+/* Statistics about a Scroller's memory use and performance */
+typedef struct scroller_stats *scroller_stats_t;
+
+struct scroller_stats {
+    /* The number of glyphs currently allocated */
+    unsigned long glyph_count;
+
+    /* The largest number of glyphs ever allocated at once */
+    unsigned long glyph_peak;
+
+    /* The number of glyph holders currently allocated */
+    unsigned long holder_count;
+
+    /* The largest number of glyph holders ever allocated at once */
+    unsigned long holder_peak;
+
+    /* The number of bytes obtained from the heap for both */
+    unsigned long heap_bytes;
+
+    /* The number of frames scrolled by the clock */
+    unsigned long frame_count;
+
+    /* The number of frames which took each multiple of
+     * SC_FRAME_BUCKET_USEC microseconds to scroll and paint.  The
+     * last bucket also counts every longer frame. */
+    unsigned long frame_times[SC_FRAME_BUCKETS];
+};
+
+/* Fills in stats with the receiver's current statistics */
+void
+ScGetStats(Widget self, scroller_stats_t stats);
+
+
 #endif /* SCROLLER_H */
@@ -43,6 +43,7 @@
 #include <X11/CoreP.h>
 
 #include "Scroller.h"
+#include "hash_table.h"
 
 
 /* New fields for the Scroller widget record */
@@ -61,6 +62,42 @@ typedef struct _ScrollerClassRec {
 
 typedef struct glyph *glyph_t;
 typedef struct glyph_holder *glyph_holder_t;
+typedef struct scroller_image *scroller_image_t;
+typedef struct object_pool *object_pool_t;
+
+/* A free list of fixed-size objects which are carved out of larger
+ * blocks so that steady-state scrolling doesn't touch the heap */
+struct object_pool {
+    /* The size of each object */
+    size_t size;
+
+    /* The objects which are available for reuse */
+    void *free_list;
+
+    /* The blocks from which the objects were carved */
+    void *blocks;
+
+    /* The number of objects currently in use */
+    unsigned long count;
+
+    /* The largest number of objects ever in use at once */
+    unsigned long peak;
+
+    /* The number of bytes obtained from the heap */
+    unsigned long bytes;
+};
+
+/* The fade timer wheel's resolution in milliseconds */
+#define FADE_WHEEL_RESOLUTION 50
+
+/* The number of bits used to index the slots of each level */
+#define FADE_WHEEL_BITS 6
+
+/* The number of slots in each level of the fade timer wheel */
+#define FADE_WHEEL_SLOTS (1 << FADE_WHEEL_BITS)
+
+/* The number of levels in the fade timer wheel */
+#define FADE_WHEEL_LEVELS 3
 
 /* New fields for the Scroller widget record */
 typedef struct {
@@ -70,15 +107,19 @@ typedef struct {
     XtCallbackList kill_callbacks;
     XFontStruct *font;
     const char *code_set;
+    const char *xft_font;
     Pixel group_pixel;
     Pixel user_pixel;
     Pixel string_pixel;
     Pixel separator_pixel;
     Dimension fade_levels;
     Boolean use_pixmap;
+    Boolean cache_glyphs;
+    Boolean use_image;
     Position drag_delta;
     Dimension frequency;
     Position step;
+    Boolean adaptive_speed;
 
     /* Private state */
 
@@ -88,12 +129,65 @@ typedef struct {
     /* The timer used to do the scrolling */
     XtIntervalId timer;
 
+    /* The time at which the last frame was scrolled (in seconds) */
+    double last_frame;
+
+    /* The time at which the next frame is due (in seconds) */
+    double next_frame;
+
+    /* The distance we should have scrolled but haven't yet because
+     * it's less than a pixel */
+    double owed;
+
+    /* The factor by which the backlog requires us to exceed the step
+     * size when adaptive_speed is set */
+    double speed_factor;
+
+    /* The time at which speed_factor should next be recomputed */
+    double next_adapt;
+
+    /* The timer used to advance the fade wheel when the scroll timer
+     * isn't running */
+    XtIntervalId fade_timer;
+
+    /* The lists of glyphs waiting to fade, indexed by level and slot */
+    glyph_t fade_wheel[FADE_WHEEL_LEVELS][FADE_WHEEL_SLOTS];
+
+    /* The glyphs which are due to fade on the current tick */
+    glyph_t fade_due;
+
+    /* The next fade wheel tick to be processed */
+    unsigned long fade_time;
+
+    /* The number of glyphs in the fade wheel */
+    unsigned int fade_count;
+
+    /* True if some glyphs have faded but haven't been repainted */
+    Bool fade_dirty;
+
     /* True if there are no messages to scroll */
     Bool is_stopped;
 
+    /* The parts of the offscreen pixmap or image which have been
+     * repainted but not yet copied onto the window */
+    Region damage;
+
     /* True if the scroller is visible */
     Bool is_visible;
 
+    /* True if the scroller's window is completely covered */
+    Bool is_obscured;
+
+    /* True if the scroller or its shell is unmapped */
+    Bool is_unmapped;
+
+    /* True if the scroller can't be seen and so shouldn't do any
+     * work.  This is is_obscured || is_unmapped. */
+    Bool is_hidden;
+
+    /* The shell whose mapping we're watching */
+    Widget shell;
+
     /* Are we dragging? */
     Bool is_dragging;
 
@@ -114,6 +208,21 @@ typedef struct {
     /* The gap in the scroller's circular queue of glyphs */
     glyph_t gap;
 
+    /* The glyphs in the queue indexed by their messages' tags */
+    hash_table_t tags;
+
+    /* The storage for our glyphs */
+    struct object_pool glyph_pool;
+
+    /* The storage for our glyph holders */
+    struct object_pool holder_pool;
+
+    /* The number of frames scrolled by the clock */
+    unsigned long frame_count;
+
+    /* The histogram of the time taken by each frame */
+    unsigned long frame_times[SC_FRAME_BUCKETS];
+
     /* The minimum width for the gap */
     int min_gap_width;
 
@@ -155,12 +264,20 @@ typedef struct {
     /* The off-screen pixmap */
     Pixmap pixmap;
 
+    /* The client-side rendering of the scroller, or NULL if we're not
+     * using the image backend */
+    scroller_image_t image;
+
     /* The GC used to draw the Scroller's background */
     GC backgroundGC;
 
     /* The GC used to draw various glyphs */
     GC gc;
 
+    /* The GC used to render glyphs into their off-screen pixmaps and
+     * to copy them into place */
+    GC glyphGC;
+
     /* The array of Pixels used to display the group portion of a
      * message at varying degrees of fading */
     Pixel *group_pixels;
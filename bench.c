@@ -0,0 +1,483 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+/* A rendering benchmark for the Scroller and History widgets.  It
+ * feeds both widgets a stream of synthetic messages and reports how
+ * quickly the scroller can draw its frames.  Pass -xrm '*xftFont: Sans-12'
+ * to measure the Xft renderer against the core font one. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h> /* fprintf, printf, snprintf */
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h> /* atof, atoi, exit, rand, srand */
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h> /* strcmp */
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h> /* getopt */
+#endif
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h> /* gettimeofday */
+#endif
+#include <sys/resource.h> /* getrusage */
+#ifdef HAVE_ASSERT_H
+# include <assert.h> /* assert */
+#endif
+#include <X11/Xlib.h>
+#include <X11/Intrinsic.h>
+#include <X11/StringDefs.h>
+#include <X11/Shell.h>
+#include <Xm/XmAll.h>
+#include <elvin/elvin.h>
+#include "globals.h"
+#include "replace.h"
+#include "message.h"
+#include "utils.h"
+#include "Scroller.h"
+#include "History.h"
+
+#define OPTIONS "d:f:hm:r:s:S:"
+
+/* The number of times per second to add messages */
+#define FEED_FREQUENCY 100
+
+/* The number of distinct replacement tags to use */
+#define TAG_COUNT 16
+
+/* The number of buckets in the message insertion histograms */
+#define ADD_BUCKETS 1000
+
+/* The width of each insertion histogram bucket in microseconds */
+#define ADD_BUCKET_USEC 10
+
+#if defined(ELVIN_VERSION_AT_LEAST)
+elvin_client_t client = NULL;
+#endif
+
+/* The name of the executable */
+const char *progname = NULL;
+
+Atom atoms[AN_MAX + 1];
+
+/* The names of the atoms to intern, in atom_index_t order */
+static const char *atom_names[AN_MAX + 1] = {
+    "CHARSET_ENCODING",
+    "CHARSET_REGISTRY",
+    "TARGETS",
+    "UTF8_STRING",
+    "_MOTIF_CLIPBOARD_TARGETS"
+};
+
+/* Message bodies of assorted widths and scripts */
+static const char *strings[] = {
+    "ok",
+    "build 4711 passed",
+    "ACME 12.34 +0.56",
+    "the quick brown fox jumps over the lazy dog",
+    "caf\xc3\xa9 cr\xc3\xa8me br\xc3\xbbl\xc3\xa9""e \xe2\x80\x94 na\xc3\xafve "
+    "fa\xc3\xa7""ade",
+    "\xce\x93\xce\xb5\xce\xb9\xce\xac \xcf\x83\xce\xbf\xcf\x85 "
+    "\xce\xba\xcf\x8c\xcf\x83\xce\xbc\xce\xb5",
+    "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82, "
+    "\xd0\xbc\xd0\xb8\xd1\x80! \xe2\x9c\x93 \xe2\x86\x92 \xe2\x82\xac""42",
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do "
+    "eiusmod tempor incididunt ut labore et dolore magna aliqua.  Ut "
+    "enim ad minim veniam, quis nostrud exercitation ullamco laboris "
+    "nisi ut aliquip ex ea commodo consequat."
+};
+
+/* The groups to send messages to */
+static const char *groups[] = {
+    "Chat", "builds", "stocks", "incidents", "xtickertape"
+};
+
+/* The users who send them */
+static const char *users[] = {
+    "phelps", "arnold", "ilana", "d", "build-bot"
+};
+
+/* A MIME attachment for some of the messages */
+static const char attachment[] =
+    "Content-Type: text/uri-list\n\nhttp://www.example.com/\n";
+
+/* The state of the benchmark */
+typedef struct bench *bench_t;
+struct bench {
+    /* The scroller */
+    Widget scroller;
+
+    /* The history */
+    Widget history;
+
+    /* The number of messages to add per second */
+    double rate;
+
+    /* The number of messages which should have been added so far but
+     * haven't been */
+    double owed;
+
+    /* The time of the last feed (in seconds) */
+    double last_feed;
+
+    /* The number of messages added */
+    unsigned long count;
+
+    /* The X request number when the benchmark started */
+    unsigned long first_request;
+
+    /* The time at which the benchmark started */
+    double start;
+
+    /* Histograms of the time taken to add each message */
+    unsigned long scroller_times[ADD_BUCKETS];
+    unsigned long history_times[ADD_BUCKETS];
+};
+
+/* Print out usage message */
+static void
+usage(int argc, char *argv[])
+{
+    fprintf(stderr,
+            "usage: %s [OPTION]...\n"
+            "  -d seconds      run for this long (default 30)\n"
+            "  -r rate         messages per second (default 20)\n"
+            "  -f frequency    scroller frames per second\n"
+            "  -S step         scroller step size\n"
+            "  -m mode         window, pixmap or image (default window)\n"
+            "  -s seed         random number seed\n"
+            "  -h              print this message\n"
+            "Standard X toolkit options such as -xrm are also accepted.\n",
+            argv[0]);
+}
+
+/* Returns the current time in seconds */
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Adds a sample to a histogram */
+static void
+record(unsigned long *histogram, double seconds)
+{
+    long bucket = (long)(seconds * 1e6 / ADD_BUCKET_USEC);
+
+    histogram[bucket < ADD_BUCKETS ? bucket : ADD_BUCKETS - 1]++;
+}
+
+/* Returns the given percentile of a histogram in microseconds */
+static double
+percentile(unsigned long *histogram, int count, int width, double fraction)
+{
+    unsigned long total = 0;
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        total += histogram[i];
+    }
+
+    for (i = 0; i < count; i++) {
+        sum += histogram[i];
+        if (total != 0 && sum >= fraction * total) {
+            return (i + 1) * width;
+        }
+    }
+
+    return 0.0;
+}
+
+/* Prints the percentiles of a histogram */
+static void
+print_percentiles(const char *name, unsigned long *histogram, int count,
+                  int width)
+{
+    printf("%-22s p50 %6.0fus  p90 %6.0fus  p99 %6.0fus  max %6.0fus\n",
+           name,
+           percentile(histogram, count, width, 0.5),
+           percentile(histogram, count, width, 0.9),
+           percentile(histogram, count, width, 0.99),
+           percentile(histogram, count, width, 1.0));
+}
+
+/* Constructs a random message */
+static message_t
+make_message(bench_t self)
+{
+    char id[32];
+    char reply_id[32];
+    char tag[32];
+    int has_tag = rand() % 4 == 0;
+    int has_reply = self->count != 0 && rand() % 3 == 0;
+    int has_attachment = rand() % 8 == 0;
+
+    snprintf(id, sizeof(id), "bench-%lu", self->count);
+    if (has_reply) {
+        snprintf(reply_id, sizeof(reply_id), "bench-%lu",
+                 self->count - 1 - rand() % MIN(self->count, 64));
+    }
+    snprintf(tag, sizeof(tag), "tag-%d", rand() % TAG_COUNT);
+
+    return message_alloc(
+        NULL,
+        groups[rand() % XtNumber(groups)],
+        users[rand() % XtNumber(users)],
+        strings[rand() % XtNumber(strings)],
+        10 + rand() % 50,
+        has_attachment ? attachment : NULL,
+        has_attachment ? sizeof(attachment) - 1 : 0,
+        has_tag ? tag : NULL,
+        id,
+        has_reply ? reply_id : NULL,
+        NULL);
+}
+
+/* Adds however many messages are due */
+static void
+feed(XtPointer closure, XtIntervalId *id)
+{
+    bench_t self = (bench_t)closure;
+    double time = now();
+    double start;
+    message_t message;
+
+    /* Work out how many messages we owe */
+    self->owed += (time - self->last_feed) * self->rate;
+    self->last_feed = time;
+
+    while (self->owed >= 1.0) {
+        message = make_message(self);
+        if (message == NULL) {
+            break;
+        }
+
+        MESSAGE_ALLOC_REF(message, "bench", self);
+
+        start = now();
+        HistoryAddMessage(self->history, message);
+        record(self->history_times, now() - start);
+
+        start = now();
+        ScAddMessage(self->scroller, message);
+        record(self->scroller_times, now() - start);
+
+        MESSAGE_FREE_REF(message, "bench", self);
+        self->count++;
+        self->owed -= 1.0;
+    }
+
+    XtAppAddTimeOut(XtWidgetToApplicationContext(self->scroller),
+                    1000 / FEED_FREQUENCY, feed, self);
+}
+
+/* Prints the results and exits */
+static void
+finish(XtPointer closure, XtIntervalId *id)
+{
+    bench_t self = (bench_t)closure;
+    Display *display = XtDisplay(self->scroller);
+    double elapsed = now() - self->start;
+    unsigned long requests;
+    struct scroller_stats stats;
+    struct history_stats history_stats;
+    struct rusage usage;
+
+    /* Make sure the server has caught up */
+    XSync(display, False);
+    requests = NextRequest(display) - self->first_request;
+
+    ScGetStats(self->scroller, &stats);
+    HistoryGetStats(self->history, &history_stats);
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("messages               %lu in %.1fs\n", self->count, elapsed);
+    printf("frames                 %lu (%.1f per second)\n",
+           stats.frame_count, stats.frame_count / elapsed);
+    printf("requests per frame     %.1f\n",
+           stats.frame_count == 0 ? 0.0 :
+           (double)requests / stats.frame_count);
+    print_percentiles("frame time", stats.frame_times, SC_FRAME_BUCKETS,
+                      SC_FRAME_BUCKET_USEC);
+    print_percentiles("ScAddMessage", self->scroller_times, ADD_BUCKETS,
+                      ADD_BUCKET_USEC);
+    print_percentiles("HistoryAddMessage", self->history_times, ADD_BUCKETS,
+                      ADD_BUCKET_USEC);
+    printf("glyphs                 %lu (peak %lu)\n",
+           stats.glyph_count, stats.glyph_peak);
+    printf("glyph holders          %lu (peak %lu)\n",
+           stats.holder_count, stats.holder_peak);
+    printf("scroller heap          %lu bytes\n", stats.heap_bytes);
+    printf("history copies         %lu (%lu compensated, %lu overflowed)\n",
+           history_stats.copy_count, history_stats.compensate_count,
+           history_stats.overflow_count);
+    printf("history full redraws   %lu\n", history_stats.full_redraw_count);
+    printf("maximum RSS            %ld kB\n", usage.ru_maxrss);
+    exit(0);
+}
+
+/* Parse args and go */
+int
+main(int argc, char *argv[])
+{
+    XtAppContext context;
+    Widget top;
+    Widget shell;
+    Widget scroll_window;
+    struct bench bench;
+    double duration = 30.0;
+    const char *mode = "window";
+    int frequency = 0;
+    int step = 0;
+    int choice;
+
+    /* Determine the name of the executable. */
+    progname = xbasename(argv[0]);
+
+    /* Let the toolkit take its options first */
+    top = XtVaAppInitialize(&context, "XTickertape", NULL, 0,
+                            &argc, argv, NULL, NULL);
+
+    memset(&bench, 0, sizeof(bench));
+    bench.rate = 20.0;
+    srand(1);
+
+    while ((choice = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (choice) {
+        case 'd':
+            duration = atof(optarg);
+            break;
+
+        case 'f':
+            frequency = atoi(optarg);
+            break;
+
+        case 'm':
+            mode = optarg;
+            break;
+
+        case 'r':
+            bench.rate = atof(optarg);
+            break;
+
+        case 's':
+            srand(atoi(optarg));
+            break;
+
+        case 'S':
+            step = atoi(optarg);
+            break;
+
+        case 'h':
+            usage(argc, argv);
+            exit(0);
+
+        default:
+            usage(argc, argv);
+            exit(1);
+        }
+    }
+
+    if (strcmp(mode, "window") != 0 && strcmp(mode, "pixmap") != 0 &&
+        strcmp(mode, "image") != 0) {
+        usage(argc, argv);
+        exit(1);
+    }
+
+    /* Intern the atoms. */
+    if (!XInternAtoms(XtDisplay(top), (char **)atom_names, AN_MAX + 1,
+                      False, atoms)) {
+        fprintf(stderr, "%s: error: XInternAtoms failed\n", progname);
+        exit(1);
+    }
+
+    /* Create the scroller in the top-level shell */
+    bench.scroller = XtVaCreateManagedWidget(
+        "scroller", scrollerWidgetClass, top,
+        XtNwidth, 1000,
+        XtNusePixmap, strcmp(mode, "pixmap") == 0,
+        XtNuseImage, strcmp(mode, "image") == 0,
+        NULL);
+    if (frequency != 0) {
+        XtVaSetValues(bench.scroller, XtNfrequency, frequency, NULL);
+    }
+
+    if (step != 0) {
+        XtVaSetValues(bench.scroller, XtNstepSize, step, NULL);
+    }
+
+    /* And the history in a shell of its own */
+    shell = XtVaAppCreateShell("history", "XTickertape",
+                               topLevelShellWidgetClass, XtDisplay(top),
+                               XtNwidth, 600,
+                               XtNheight, 400,
+                               NULL);
+    scroll_window = XtVaCreateWidget(
+        "historySW", xmScrolledWindowWidgetClass, shell,
+        XmNscrollingPolicy, XmAPPLICATION_DEFINED,
+        XmNvisualPolicy, XmVARIABLE,
+        XmNscrollBarDisplayPolicy, XmSTATIC,
+        NULL);
+    bench.history = XtVaCreateManagedWidget(
+        "history", historyWidgetClass, scroll_window,
+        NULL);
+    HistorySetThreaded(bench.history, True);
+    XtVaSetValues(scroll_window, XmNworkWindow, bench.history, NULL);
+    XtManageChild(scroll_window);
+
+    XtRealizeWidget(top);
+    XtRealizeWidget(shell);
+
+    /* Start feeding messages and set the alarm */
+    bench.start = bench.last_feed = now();
+    bench.first_request = NextRequest(XtDisplay(top));
+    XtAppAddTimeOut(context, 1000 / FEED_FREQUENCY, feed, &bench);
+    XtAppAddTimeOut(context, (unsigned long)(duration * 1000), finish, &bench);
+
+    printf("%s: %s mode, %.1f messages per second for %.0f seconds\n",
+           progname, mode, bench.rate, duration);
+    XtAppMainLoop(context);
+    return 0;
+}
@@ -0,0 +1,268 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h> /* calloc, free, malloc */
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h> /* strcmp */
+#endif
+#include "hash_table.h"
+
+/* The initial number of buckets; always a power of two */
+#define TABLE_MIN_SIZE 16
+
+/* A single bucket.  An empty bucket has a NULL key. */
+typedef struct hash_entry *hash_entry_t;
+struct hash_entry {
+    /* The key */
+    const char *key;
+
+    /* The key's hash code */
+    unsigned long hash;
+
+    /* The value stored under the key */
+    void *value;
+};
+
+struct hash_table {
+    /* The buckets */
+    hash_entry_t entries;
+
+    /* The number of buckets (a power of two) */
+    unsigned int size;
+
+    /* The number of occupied buckets */
+    unsigned int count;
+};
+
+/* Computes the FNV-1a hash of a string */
+static unsigned long
+hash_string(const char *string)
+{
+    const unsigned char *point = (const unsigned char *)string;
+    unsigned long hash = 2166136261UL;
+
+    while (*point != '\0') {
+        hash ^= *point++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/* Returns the bucket holding key, or the empty bucket at which it
+ * would be inserted */
+static hash_entry_t
+hash_table_find(hash_table_t self, const char *key, unsigned long hash)
+{
+    unsigned int mask = self->size - 1;
+    unsigned int index = hash & mask;
+    hash_entry_t entry;
+
+    /* Probe linearly.  The table is never full, so this terminates. */
+    for (;;) {
+        entry = self->entries + index;
+        if (entry->key == NULL) {
+            return entry;
+        }
+
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+/* Resizes the table's array of buckets */
+static int
+hash_table_resize(hash_table_t self, unsigned int size)
+{
+    hash_entry_t entries = self->entries;
+    unsigned int old_size = self->size;
+    hash_entry_t entry;
+    unsigned int i;
+
+    /* Allocate the new buckets */
+    self->entries = calloc(size, sizeof(struct hash_entry));
+    if (self->entries == NULL) {
+        self->entries = entries;
+        return -1;
+    }
+
+    self->size = size;
+
+    /* Move the entries across */
+    for (i = 0; i < old_size; i++) {
+        if (entries[i].key != NULL) {
+            entry = hash_table_find(self, entries[i].key, entries[i].hash);
+            *entry = entries[i];
+        }
+    }
+
+    free(entries);
+    return 0;
+}
+
+/* Allocates and initializes a new, empty hash_table */
+hash_table_t
+hash_table_alloc(void)
+{
+    hash_table_t self;
+
+    /* Allocate memory for the table */
+    self = malloc(sizeof(struct hash_table));
+    if (self == NULL) {
+        return NULL;
+    }
+
+    /* And for its buckets */
+    self->entries = calloc(TABLE_MIN_SIZE, sizeof(struct hash_entry));
+    if (self->entries == NULL) {
+        free(self);
+        return NULL;
+    }
+
+    self->size = TABLE_MIN_SIZE;
+    self->count = 0;
+    return self;
+}
+
+/* Frees the resources consumed by the hash_table */
+void
+hash_table_free(hash_table_t self)
+{
+    free(self->entries);
+    free(self);
+}
+
+/* Returns the value stored under key, or NULL if there is none */
+void *
+hash_table_get(hash_table_t self, const char *key)
+{
+    return hash_table_find(self, key, hash_string(key))->value;
+}
+
+/* Stores value under key, replacing any existing value */
+int
+hash_table_put(hash_table_t self, const char *key, void *value)
+{
+    unsigned long hash = hash_string(key);
+    hash_entry_t entry;
+
+    /* Replacing an existing value never needs more room */
+    entry = hash_table_find(self, key, hash);
+    if (entry->key == NULL) {
+        /* Keep the table at most three quarters full */
+        if (4 * (self->count + 1) > 3 * self->size) {
+            if (hash_table_resize(self, self->size * 2) < 0) {
+                return -1;
+            }
+
+            entry = hash_table_find(self, key, hash);
+        }
+
+        self->count++;
+    }
+
+    entry->key = key;
+    entry->hash = hash;
+    entry->value = value;
+    return 0;
+}
+
+/* Removes key from the table, returning its value */
+void *
+hash_table_remove(hash_table_t self, const char *key)
+{
+    unsigned int mask = self->size - 1;
+    hash_entry_t entry;
+    hash_entry_t probe;
+    unsigned int hole;
+    unsigned int index;
+    unsigned int home;
+    void *value;
+
+    /* Find the key */
+    entry = hash_table_find(self, key, hash_string(key));
+    if (entry->key == NULL) {
+        return NULL;
+    }
+
+    value = entry->value;
+    self->count--;
+
+    /* Shift any later entries in the run back into the hole so that
+     * lookups never need tombstones */
+    hole = entry - self->entries;
+    index = hole;
+    for (;;) {
+        index = (index + 1) & mask;
+        probe = self->entries + index;
+        if (probe->key == NULL) {
+            break;
+        }
+
+        /* Leave entries which are already between their home bucket
+         * and the hole */
+        home = probe->hash & mask;
+        if (((index - home) & mask) < ((index - hole) & mask)) {
+            continue;
+        }
+
+        self->entries[hole] = *probe;
+        hole = index;
+    }
+
+    self->entries[hole].key = NULL;
+    self->entries[hole].value = NULL;
+    return value;
+}
+
+/* Returns the number of keys in the table */
+unsigned int
+hash_table_count(hash_table_t self)
+{
+    return self->count;
+}
@@ -0,0 +1,79 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+/* An open-addressed hash table mapping strings to pointers.  The
+ * table doesn't copy its keys: each key must remain valid and
+ * unchanged until it is removed from the table. */
+typedef struct hash_table *hash_table_t;
+
+/* Allocates and initializes a new, empty hash_table */
+hash_table_t
+hash_table_alloc(void);
+
+
+/* Frees the resources consumed by the hash_table */
+void
+hash_table_free(hash_table_t self);
+
+
+/* Returns the value stored under key, or NULL if there is none */
+void *
+hash_table_get(hash_table_t self, const char *key);
+
+
+/* Stores value under key, replacing any existing value.  Returns 0
+ * on success, -1 if memory couldn't be allocated. */
+int
+hash_table_put(hash_table_t self, const char *key, void *value);
+
+
+/* Removes key from the table, returning its value or NULL if it
+ * wasn't present */
+void *
+hash_table_remove(hash_table_t self, const char *key);
+
+
+/* Returns the number of keys in the table */
+unsigned int
+hash_table_count(hash_table_t self);
+
+#endif /* HASH_TABLE_H */
@@ -0,0 +1,284 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+/* A test of the History widget's archive.  It fills a small history
+ * with a large archive with replies to old threads, toggles the
+ * threading as it goes and checks that every message is on exactly
+ * one line or archived row. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h> /* fprintf, printf, snprintf */
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h> /* atoi, calloc, exit, free, rand, srand */
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h> /* strcmp */
+#endif
+#include <X11/Xlib.h>
+#include <X11/IntrinsicP.h>
+#include <X11/StringDefs.h>
+#include <X11/Shell.h>
+#include <Xm/XmAll.h>
+#include <Xm/PrimitiveP.h>
+#include <elvin/elvin.h>
+#include "globals.h"
+#include "replace.h"
+#include "message.h"
+#include "utils.h"
+#include "utf8.h"
+#include "message_view.h"
+#include "hash_table.h"
+#include "message_store.h"
+#include "search_index.h"
+#include "History.h"
+#include "HistoryP.h"
+
+/* The number of messages to add */
+#define MESSAGE_COUNT 400
+
+/* The number of lines in the history */
+#define MESSAGE_CAPACITY 12
+
+/* The number of archived rows above them, enough for every message */
+#define ARCHIVE_CAPACITY MESSAGE_COUNT
+
+/* How far back a reply may reach */
+#define REPLY_RANGE 40
+
+#if defined(ELVIN_VERSION_AT_LEAST)
+elvin_client_t client = NULL;
+#endif
+
+/* The name of the executable */
+const char *progname = NULL;
+
+Atom atoms[AN_MAX + 1];
+
+/* The names of the atoms to intern, in atom_index_t order */
+static const char *atom_names[AN_MAX + 1] = {
+    "CHARSET_ENCODING",
+    "CHARSET_REGISTRY",
+    "TARGETS",
+    "UTF8_STRING",
+    "_MOTIF_CLIPBOARD_TARGETS"
+};
+
+/* Records that a row shows the message with the given string, and
+ * complains if another row already does */
+static int
+count_row(int *seen, const char *string, const char *where, unsigned int row)
+{
+    int n;
+
+    n = atoi(string + 1);
+    if (string[0] != 'm' || n < 0 || MESSAGE_COUNT <= n) {
+        fprintf(stderr, "%s: %s row %u shows unknown message \"%s\"\n",
+                progname, where, row, string);
+        return -1;
+    }
+
+    if (seen[n]++ != 0) {
+        fprintf(stderr, "%s: %s row %u shows %s again\n",
+                progname, where, row, string);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Checks that each of the first count messages appears on exactly one
+ * row.  Returns 0 if so, -1 if not. */
+static int
+check(HistoryWidget self, int count, const char *step)
+{
+    int *seen;
+    unsigned int i;
+    history_line_t line;
+    message_t message;
+    int result = 0;
+    int n;
+
+    seen = calloc(MESSAGE_COUNT, sizeof(int));
+    if (seen == NULL) {
+        perror("calloc failed");
+        exit(1);
+    }
+
+    /* Count the archived rows */
+    for (i = 0; i < self->history.archive_count; i++) {
+        message = message_store_get(self->history.archive, i);
+        MESSAGE_ALLOC_REF(message, "history_test", seen);
+        if (count_row(seen, message_get_string(message), "archived",
+                      i) < 0) {
+            result = -1;
+        }
+        MESSAGE_FREE_REF(message, "history_test", seen);
+    }
+
+    /* And the lines below them */
+    for (i = 0; i < self->history.message_count; i++) {
+        line = &self->history.lines[(self->history.line_base + i) %
+                                    self->history.message_capacity];
+        if (count_row(seen, message_get_string(line->message), "line",
+                      i) < 0) {
+            result = -1;
+        }
+    }
+
+    /* Nothing should have been lost */
+    for (n = 0; n < count; n++) {
+        if (seen[n] != 1) {
+            fprintf(stderr, "%s: m%d is missing\n", progname, n);
+            result = -1;
+        }
+    }
+
+    if (result < 0) {
+        fprintf(stderr, "%s: failed after %s with %d messages (%s)\n",
+                progname, step, count,
+                self->history.is_threaded ? "threaded" : "unthreaded");
+    }
+
+    free(seen);
+    return result;
+}
+
+/* Constructs the nth message, replying to an earlier one half of the
+ * time */
+static message_t
+make_message(int n)
+{
+    char id[32];
+    char reply_id[32];
+    char string[32];
+    int has_reply = n != 0 && rand() % 2 == 0;
+
+    snprintf(id, sizeof(id), "id%d", n);
+    if (has_reply) {
+        snprintf(reply_id, sizeof(reply_id), "id%d",
+                 n - 1 - rand() % MIN(n, REPLY_RANGE));
+    }
+    snprintf(string, sizeof(string), "m%d", n);
+
+    return message_alloc(
+        NULL, "group", "user", string, 60,
+        NULL, 0, NULL,
+        id, has_reply ? reply_id : NULL, NULL);
+}
+
+/* Parse args and go */
+int
+main(int argc, char *argv[])
+{
+    XtAppContext context;
+    Widget top;
+    Widget scroll_window;
+    Widget history;
+    message_t message;
+    int status = 0;
+    int n;
+
+    /* Determine the name of the executable. */
+    progname = xbasename(argv[0]);
+
+    top = XtVaAppInitialize(&context, "XTickertape", NULL, 0,
+                            &argc, argv, NULL,
+                            XtNwidth, 600,
+                            XtNheight, 400,
+                            NULL);
+    srand(argc < 2 ? 1 : atoi(argv[1]));
+
+    /* Intern the atoms. */
+    if (!XInternAtoms(XtDisplay(top), (char **)atom_names, AN_MAX + 1,
+                      False, atoms)) {
+        fprintf(stderr, "%s: error: XInternAtoms failed\n", progname);
+        exit(1);
+    }
+
+    scroll_window = XtVaCreateWidget(
+        "historySW", xmScrolledWindowWidgetClass, top,
+        XmNscrollingPolicy, XmAPPLICATION_DEFINED,
+        XmNvisualPolicy, XmVARIABLE,
+        XmNscrollBarDisplayPolicy, XmSTATIC,
+        NULL);
+    history = XtVaCreateManagedWidget(
+        "history", historyWidgetClass, scroll_window,
+        XtNmessageCapacity, MESSAGE_CAPACITY,
+        XtNarchiveCapacity, ARCHIVE_CAPACITY,
+        NULL);
+    HistorySetThreaded(history, True);
+    XtVaSetValues(scroll_window, XmNworkWindow, history, NULL);
+    XtManageChild(scroll_window);
+    XtRealizeWidget(top);
+
+    for (n = 0; n < MESSAGE_COUNT; n++) {
+        message = make_message(n);
+        if (message == NULL) {
+            fprintf(stderr, "%s: message_alloc failed\n", progname);
+            exit(1);
+        }
+
+        MESSAGE_ALLOC_REF(message, "history_test", history);
+        HistoryAddMessage(history, message);
+        MESSAGE_FREE_REF(message, "history_test", history);
+        if (check((HistoryWidget)history, n + 1, "adding") < 0) {
+            status = 1;
+            break;
+        }
+
+        /* Toggle the threading now and then */
+        if (rand() % 10 == 0) {
+            HistorySetThreaded(
+                history, !((HistoryWidget)history)->history.is_threaded);
+            if (check((HistoryWidget)history, n + 1, "toggling") < 0) {
+                status = 1;
+                break;
+            }
+        }
+    }
+
+    if (status == 0) {
+        printf("%s: ok\n", progname);
+    }
+
+    XtDestroyWidget(top);
+    return status;
+}
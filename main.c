@@ -199,6 +199,8 @@ usage(int argc, char *argv[])
 #define XtCMetamail "Metamail"
 #define XtNsendHistoryCapacity "sendHistoryCapacity"
 #define XtCSendHistoryCapacity "SendHistoryCapacity"
+#define XtNhistoryLogCapacity "historyLogCapacity"
+#define XtCHistoryLogCapacity "HistoryLogCapacity"
 
 /* The application shell window also has resources */
 #define offset(field) XtOffsetOf(XTickertapeRec, field)
@@ -220,6 +222,12 @@ static XtResource resources[] =
     {
         XtNsendHistoryCapacity, XtCSendHistoryCapacity, XtRInt, sizeof(int),
         offset(send_history_count), XtRImmediate, (XtPointer)8
+    },
+
+    /* int historyLogCapacity */
+    {
+        XtNhistoryLogCapacity, XtCHistoryLogCapacity, XtRInt, sizeof(int),
+        offset(history_log_count), XtRImmediate, (XtPointer)0
     }
 };
 #undef offset
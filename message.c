@@ -509,6 +509,14 @@ message_get_creation_time(message_t self)
     return &self->creation_time.tv_sec;
 }
 
+/* Sets the receiver's creation time */
+void
+message_set_creation_time(message_t self, time_t when)
+{
+    self->creation_time.tv_sec = when;
+    self->creation_time.tv_usec = 0;
+}
+
 /* Answers the receiver's group */
 const char *
 message_get_group(message_t self)
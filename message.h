@@ -117,6 +117,11 @@ time_t *
 message_get_creation_time(message_t self);
 
 
+/* Sets the receiver's creation time */
+void
+message_set_creation_time(message_t self, time_t when);
+
+
 /* Answers the receiver's group */
 const char *
 message_get_group(message_t self);
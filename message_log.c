@@ -0,0 +1,663 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h> /* fprintf, perror, rename, snprintf */
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h> /* free, malloc */
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h> /* memcmp, memcpy, strdup, strlen, strrchr */
+#endif
+#ifdef HAVE_TIME_H
+# include <time.h> /* time_t */
+#endif
+#ifdef HAVE_SYS_TYPES_H
+# include <sys/types.h> /* fstat, ftruncate, mmap, open */
+#endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h> /* fstat, open */
+#endif
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h> /* open */
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h> /* close, fsync, ftruncate, read, unlink, write */
+#endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h> /* mmap, munmap */
+#endif
+#ifdef HAVE_ERRNO_H
+# include <errno.h> /* errno */
+#endif
+#ifdef HAVE_ASSERT_H
+# include <assert.h> /* assert */
+#endif
+#include "replace.h"
+#include "globals.h"
+#include "message.h"
+#include "message_log.h"
+
+/* The bytes at the start of every log file */
+#define LOG_MAGIC "XTL1"
+#define LOG_MAGIC_SIZE 4
+
+/* The suffix of the file written while compacting a log */
+#define COMPACT_SUFFIX ".new"
+
+/* The fields of a record, after its creation time and timeout.  Each
+ * is a 32-bit length followed by that many bytes.  Strings include
+ * their NUL terminator so that they can be used in place; a NULL
+ * string has length 0. */
+typedef enum {
+    FIELD_INFO,
+    FIELD_GROUP,
+    FIELD_USER,
+    FIELD_STRING,
+    FIELD_TAG,
+    FIELD_ID,
+    FIELD_REPLY_ID,
+    FIELD_THREAD_ID,
+    FIELD_ATTACHMENT,
+    FIELD_COUNT
+} field_t;
+
+/* The size of a record's length prefix */
+#define LENGTH_SIZE 4
+
+/* The size of the fixed part of a record body: the creation time (64
+ * bits), timeout and the field lengths */
+#define FIXED_SIZE (4 * 3 + 4 * FIELD_COUNT)
+
+struct message_log {
+    /* The name of the log file */
+    char *filename;
+
+    /* The file descriptor, opened for appending */
+    int fd;
+
+    /* The number of records to keep */
+    unsigned long capacity;
+
+    /* The number of records in the file */
+    unsigned long count;
+
+    /* The number of records at which to next compact the file */
+    unsigned long compact_count;
+
+    /* The size of the file's complete records, including the magic */
+    off_t size;
+};
+
+/* Writes a 32-bit big-endian integer */
+static void
+put_uint32(unsigned char *point, unsigned long value)
+{
+    point[0] = (unsigned char)(value >> 24);
+    point[1] = (unsigned char)(value >> 16);
+    point[2] = (unsigned char)(value >> 8);
+    point[3] = (unsigned char)value;
+}
+
+/* Reads a 32-bit big-endian integer */
+static unsigned long
+get_uint32(const unsigned char *point)
+{
+    return ((unsigned long)point[0] << 24) | ((unsigned long)point[1] << 16) |
+        ((unsigned long)point[2] << 8) | (unsigned long)point[3];
+}
+
+/* Writes all of a buffer to a file descriptor */
+static int
+write_all(int fd, const unsigned char *buffer, size_t length)
+{
+    ssize_t count;
+
+    while (length != 0) {
+        count = write(fd, buffer, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        buffer += count;
+        length -= count;
+    }
+
+    return 0;
+}
+
+/* Returns the contents of the log file, or NULL if it is empty (in
+ * which case *size_out is 0) or can't be read */
+static const unsigned char *
+log_map(message_log_t self, size_t *size_out)
+{
+    struct stat statbuf;
+    unsigned char *buffer;
+#if !defined(HAVE_MMAP)
+    size_t offset;
+    ssize_t count;
+#endif
+
+    *size_out = 0;
+    if (fstat(self->fd, &statbuf) < 0) {
+        perror(self->filename);
+        return NULL;
+    }
+
+    if (statbuf.st_size == 0) {
+        return NULL;
+    }
+
+    *size_out = (size_t)statbuf.st_size;
+
+#if defined(HAVE_MMAP)
+    buffer = mmap(NULL, *size_out, PROT_READ, MAP_PRIVATE, self->fd, 0);
+    if (buffer == MAP_FAILED) {
+        perror("mmap() failed");
+        return NULL;
+    }
+#else /* !HAVE_MMAP */
+    /* Read the whole file instead */
+    buffer = malloc(*size_out);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    for (offset = 0; offset < *size_out; offset += count) {
+        count = pread(self->fd, buffer + offset, *size_out - offset, offset);
+        if (count <= 0) {
+            free(buffer);
+            return NULL;
+        }
+    }
+#endif /* HAVE_MMAP */
+
+    return buffer;
+}
+
+/* Releases the contents returned by log_map() */
+static void
+log_unmap(const unsigned char *buffer, size_t size)
+{
+#if defined(HAVE_MMAP)
+    munmap((void *)buffer, size);
+#else /* !HAVE_MMAP */
+    free((void *)buffer);
+#endif /* HAVE_MMAP */
+}
+
+/* Returns the record after the one at point, or NULL if the one at
+ * point is incomplete */
+static const unsigned char *
+record_next(const unsigned char *point, const unsigned char *end)
+{
+    unsigned long length;
+
+    if (end - point < LENGTH_SIZE) {
+        return NULL;
+    }
+
+    length = get_uint32(point);
+    if ((unsigned long)(end - point - LENGTH_SIZE) < length) {
+        return NULL;
+    }
+
+    return point + LENGTH_SIZE + length;
+}
+
+/* Rebuilds a message from a record body, or returns NULL if the
+ * record is malformed */
+static message_t
+record_decode(const unsigned char *body, unsigned long length)
+{
+    const char *fields[FIELD_COUNT];
+    unsigned long lengths[FIELD_COUNT];
+    const unsigned char *point;
+    message_t message;
+    unsigned long timeout;
+    time_t when;
+    int i;
+
+    if (length < FIXED_SIZE) {
+        return NULL;
+    }
+
+    /* The creation time is split into two 32-bit halves */
+    when = (time_t)get_uint32(body);
+    when = (when << 16) << 16;
+    when |= (time_t)get_uint32(body + 4);
+    timeout = get_uint32(body + 8);
+
+    /* Find each field in the rest of the record */
+    point = body + FIXED_SIZE;
+    length -= FIXED_SIZE;
+    for (i = 0; i < FIELD_COUNT; i++) {
+        lengths[i] = get_uint32(body + 12 + 4 * i);
+        if (length < lengths[i]) {
+            return NULL;
+        }
+
+        /* Make sure strings are properly terminated */
+        if (lengths[i] == 0) {
+            fields[i] = NULL;
+        } else if (i != FIELD_ATTACHMENT && point[lengths[i] - 1] != '\0') {
+            return NULL;
+        } else {
+            fields[i] = (const char *)point;
+        }
+
+        point += lengths[i];
+        length -= lengths[i];
+    }
+
+    /* The group, user and string are mandatory */
+    if (fields[FIELD_GROUP] == NULL || fields[FIELD_USER] == NULL ||
+        fields[FIELD_STRING] == NULL) {
+        return NULL;
+    }
+
+    message = message_alloc(fields[FIELD_INFO],
+                            fields[FIELD_GROUP],
+                            fields[FIELD_USER],
+                            fields[FIELD_STRING],
+                            (unsigned int)timeout,
+                            fields[FIELD_ATTACHMENT],
+                            lengths[FIELD_ATTACHMENT],
+                            fields[FIELD_TAG],
+                            fields[FIELD_ID],
+                            fields[FIELD_REPLY_ID],
+                            fields[FIELD_THREAD_ID]);
+    if (message == NULL) {
+        return NULL;
+    }
+
+    message_set_creation_time(message, when);
+    return message;
+}
+
+/* Flushes the directory holding the log so that a rename within it
+ * survives a crash.  Failure only costs us that guarantee. */
+static void
+log_sync_directory(message_log_t self)
+{
+    const char *slash;
+    char *directory;
+    size_t length;
+    int fd;
+
+    /* Find the directory's name */
+    slash = strrchr(self->filename, '/');
+    if (slash == NULL) {
+        directory = strdup(".");
+    } else {
+        length = slash == self->filename ? 1 : slash - self->filename;
+        directory = malloc(length + 1);
+        if (directory != NULL) {
+            memcpy(directory, self->filename, length);
+            directory[length] = '\0';
+        }
+    }
+
+    if (directory == NULL) {
+        return;
+    }
+
+    fd = open(directory, O_RDONLY);
+    if (fd < 0) {
+        perror(directory);
+        free(directory);
+        return;
+    }
+
+    if (fsync(fd) < 0) {
+        perror(directory);
+    }
+
+    close(fd);
+    free(directory);
+}
+
+/* Rewrites the log file with only its newest capacity records */
+static int
+log_compact(message_log_t self)
+{
+    const unsigned char *buffer;
+    const unsigned char *point;
+    const unsigned char *end;
+    unsigned long skip;
+    char *filename;
+    size_t length;
+    size_t size;
+    int fd;
+
+    /* Nothing to do if we're not over capacity */
+    if (self->count <= self->capacity) {
+        return 0;
+    }
+
+    buffer = log_map(self, &size);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    /* Skip past the records we're discarding */
+    end = buffer + size;
+    point = buffer + LOG_MAGIC_SIZE;
+    for (skip = self->count - self->capacity; skip != 0; skip--) {
+        point = record_next(point, end);
+        ASSERT(point != NULL);
+    }
+
+    /* Write the rest into a new file */
+    length = strlen(self->filename) + sizeof(COMPACT_SUFFIX);
+    filename = malloc(length);
+    if (filename == NULL) {
+        log_unmap(buffer, size);
+        return -1;
+    }
+
+    snprintf(filename, length, "%s%s", self->filename, COMPACT_SUFFIX);
+    fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (fd < 0) {
+        perror(filename);
+        free(filename);
+        log_unmap(buffer, size);
+        return -1;
+    }
+
+    /* Make sure the new file is on disk before it replaces the old
+     * one, or a crash could leave us with an empty log */
+    if (write_all(fd, (const unsigned char *)LOG_MAGIC, LOG_MAGIC_SIZE) < 0 ||
+        write_all(fd, point, end - point) < 0 ||
+        fsync(fd) < 0 ||
+        rename(filename, self->filename) < 0) {
+        perror(filename);
+        close(fd);
+        unlink(filename);
+        free(filename);
+        log_unmap(buffer, size);
+        return -1;
+    }
+
+    free(filename);
+    log_sync_directory(self);
+    self->size = (off_t)(LOG_MAGIC_SIZE + (end - point));
+    log_unmap(buffer, size);
+
+    /* Switch to the new file */
+    close(self->fd);
+    self->fd = fd;
+    self->count = self->capacity;
+    self->compact_count = self->capacity * 2;
+    return 0;
+}
+
+/* Compacts the log, backing off if that fails so that we don't
+ * rewrite the whole file on every append */
+static void
+log_compact_or_defer(message_log_t self)
+{
+    if (log_compact(self) < 0) {
+        self->compact_count = self->count + self->capacity;
+    }
+}
+
+/* Opens the log in filename */
+message_log_t
+message_log_open(const char *filename, unsigned long capacity)
+{
+    message_log_t self;
+    const unsigned char *buffer;
+    const unsigned char *point;
+    const unsigned char *next;
+    const unsigned char *end;
+    size_t size, valid;
+
+    /* Sanity check */
+    ASSERT(capacity != 0);
+
+    /* Allocate memory for the log */
+    self = malloc(sizeof(struct message_log));
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->filename = strdup(filename);
+    self->capacity = capacity;
+    self->count = 0;
+    self->compact_count = capacity * 2;
+    self->size = 0;
+    if (self->filename == NULL) {
+        free(self);
+        return NULL;
+    }
+
+    /* Open the file.  Other users have no business reading it. */
+    self->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (self->fd < 0) {
+        perror(filename);
+        free(self->filename);
+        free(self);
+        return NULL;
+    }
+
+    /* Start a new file with the magic bytes */
+    buffer = log_map(self, &size);
+    if (buffer == NULL) {
+        if (size != 0 ||
+            write_all(self->fd, (const unsigned char *)LOG_MAGIC,
+                      LOG_MAGIC_SIZE) < 0) {
+            perror(filename);
+            message_log_close(self);
+            return NULL;
+        }
+
+        self->size = LOG_MAGIC_SIZE;
+        return self;
+    }
+
+    /* Don't touch files which aren't logs */
+    if (size < LOG_MAGIC_SIZE ||
+        memcmp(buffer, LOG_MAGIC, LOG_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "%s: not a message log\n", filename);
+        log_unmap(buffer, size);
+        message_log_close(self);
+        return NULL;
+    }
+
+    /* Count the records */
+    end = buffer + size;
+    point = buffer + LOG_MAGIC_SIZE;
+    while (point < end && (next = record_next(point, end)) != NULL) {
+        self->count++;
+        point = next;
+    }
+
+    valid = point - buffer;
+    self->size = (off_t)valid;
+    log_unmap(buffer, size);
+
+    /* Discard any record which was only partly written, since new
+     * records would be lost behind it */
+    if (valid < size && ftruncate(self->fd, (off_t)valid) < 0) {
+        perror(filename);
+        message_log_close(self);
+        return NULL;
+    }
+
+    /* Discard the records we don't need */
+    log_compact_or_defer(self);
+    return self;
+}
+
+/* Closes the log and frees its resources */
+void
+message_log_close(message_log_t self)
+{
+    close(self->fd);
+    free(self->filename);
+    free(self);
+}
+
+/* Calls callback with each message in the log, oldest first */
+int
+message_log_replay(message_log_t self,
+                   message_log_callback_t callback,
+                   void *rock)
+{
+    const unsigned char *buffer;
+    const unsigned char *point;
+    const unsigned char *next;
+    const unsigned char *end;
+    message_t message;
+    size_t size;
+
+    buffer = log_map(self, &size);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    /* Rebuild each message straight from its record */
+    end = buffer + size;
+    point = buffer + LOG_MAGIC_SIZE;
+    while (point < end && (next = record_next(point, end)) != NULL) {
+        message = record_decode(point + LENGTH_SIZE,
+                                (unsigned long)(next - point - LENGTH_SIZE));
+        if (message != NULL) {
+            callback(rock, message);
+        }
+
+        point = next;
+    }
+
+    log_unmap(buffer, size);
+    return 0;
+}
+
+/* Appends a message to the log */
+int
+message_log_append(message_log_t self, message_t message)
+{
+    const char *fields[FIELD_COUNT];
+    unsigned long lengths[FIELD_COUNT];
+    unsigned char *buffer;
+    unsigned char *point;
+    unsigned long length;
+    time_t when;
+    int result;
+    int i;
+
+    /* Gather the fields */
+    fields[FIELD_INFO] = message_get_info(message);
+    fields[FIELD_GROUP] = message_get_group(message);
+    fields[FIELD_USER] = message_get_user(message);
+    fields[FIELD_STRING] = message_get_string(message);
+    fields[FIELD_TAG] = message_get_tag(message);
+    fields[FIELD_ID] = message_get_id(message);
+    fields[FIELD_REPLY_ID] = message_get_reply_id(message);
+    fields[FIELD_THREAD_ID] = message_get_thread_id(message);
+    lengths[FIELD_ATTACHMENT] =
+        message_get_attachment(message, &fields[FIELD_ATTACHMENT]);
+
+    /* Measure them */
+    length = FIXED_SIZE;
+    for (i = 0; i < FIELD_COUNT; i++) {
+        if (i != FIELD_ATTACHMENT) {
+            lengths[i] = fields[i] == NULL ? 0 : strlen(fields[i]) + 1;
+        }
+
+        /* The lengths must fit in 32 bits */
+        if (0xffffffffUL - length < lengths[i]) {
+            return -1;
+        }
+
+        length += lengths[i];
+    }
+
+    /* Build the record */
+    buffer = malloc(LENGTH_SIZE + length);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    when = *message_get_creation_time(message);
+    put_uint32(buffer, length);
+    put_uint32(buffer + 4, (unsigned long)((when >> 16) >> 16) & 0xffffffffUL);
+    put_uint32(buffer + 8, (unsigned long)when & 0xffffffffUL);
+    put_uint32(buffer + 12, message_get_timeout(message));
+    point = buffer + LENGTH_SIZE + FIXED_SIZE;
+    for (i = 0; i < FIELD_COUNT; i++) {
+        put_uint32(buffer + 16 + 4 * i, lengths[i]);
+        if (lengths[i] != 0) {
+            memcpy(point, fields[i], lengths[i]);
+            point += lengths[i];
+        }
+    }
+
+    /* Write it out in one go */
+    result = write_all(self->fd, buffer, LENGTH_SIZE + length);
+    free(buffer);
+    if (result < 0) {
+        perror(self->filename);
+
+        /* Don't leave part of a record for the next one to follow */
+        if (ftruncate(self->fd, self->size) < 0) {
+            perror(self->filename);
+        }
+
+        return -1;
+    }
+
+    self->size += LENGTH_SIZE + length;
+
+    /* Compact the log once it holds twice as many records as we need
+     * so that the cost of doing so is spread across the appends */
+    self->count++;
+    if (self->count >= self->compact_count) {
+        log_compact_or_defer(self);
+    }
+
+    return 0;
+}
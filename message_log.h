@@ -0,0 +1,81 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+/* An append-only file of received messages, so that the history can
+ * survive a restart.  Each record holds the fields which
+ * write_message() would write for MSGPART_ALL, plus the subscription
+ * info and timeout, in a length-prefixed binary form which can be
+ * reloaded without parsing any text.  Only the newest capacity
+ * records are kept: older ones are compacted away as the log grows. */
+typedef struct message_log *message_log_t;
+
+/* The type of function called with each message when a log is
+ * replayed.  The message has no references of its own. */
+typedef void (*message_log_callback_t)(void *rock, message_t message);
+
+
+/* Opens the log in filename, creating it if necessary, and discards
+ * all but its newest capacity records.  Returns NULL if the file
+ * can't be used as a log. */
+message_log_t
+message_log_open(const char *filename, unsigned long capacity);
+
+
+/* Closes the log and frees its resources */
+void
+message_log_close(message_log_t self);
+
+
+/* Calls callback with each message in the log, oldest first.  Returns
+ * 0 on success, -1 if the log couldn't be read. */
+int
+message_log_replay(message_log_t self,
+                   message_log_callback_t callback,
+                   void *rock);
+
+
+/* Appends a message to the log.  Returns 0 on success, -1 if it
+ * couldn't be written. */
+int
+message_log_append(message_log_t self, message_t message);
+
+#endif /* MESSAGE_LOG_H */
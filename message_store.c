@@ -0,0 +1,453 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h> /* calloc, free, malloc, realloc */
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h> /* memcpy, memmove, strlen */
+#endif
+#ifdef HAVE_TIME_H
+# include <time.h> /* time_t */
+#endif
+#ifdef HAVE_ASSERT_H
+# include <assert.h> /* assert */
+#endif
+#include "replace.h"
+#include "globals.h"
+#include "utils.h"
+#include "message.h"
+#include "hash_table.h"
+#include "message_store.h"
+
+/* The number used in place of an interned string for NULL */
+#define NO_STRING ((unsigned int)-1)
+
+/* The smallest text blob worth allocating */
+#define TEXT_MIN_SIZE 4096
+
+/* The smallest array of interned strings worth allocating */
+#define INTERNS_MIN_SIZE 16
+
+/* An interned string */
+typedef struct intern *intern_t;
+struct intern {
+    /* The number by which the columns refer to the string */
+    unsigned int number;
+
+    /* The number of fields in the store which refer to the string */
+    unsigned int ref_count;
+
+    /* The string itself */
+    char string[1];
+};
+
+struct message_store {
+    /* The maximum number of messages in the store */
+    unsigned int capacity;
+
+    /* The number of messages in the store */
+    unsigned int count;
+
+    /* The slot which holds the oldest message */
+    unsigned int first;
+
+    /* The interned info, group and user string numbers of each slot */
+    unsigned int *infos;
+    unsigned int *groups;
+    unsigned int *users;
+
+    /* The offset in the text blob of each slot's text, which is
+     * followed by its id (or an empty string if it has none) */
+    unsigned int *texts;
+
+    /* The creation time of each slot's message */
+    unsigned int *times;
+
+    /* The interned strings, indexed by number */
+    intern_t *interns;
+
+    /* The number of entries in interns */
+    unsigned int intern_size;
+
+    /* The unused numbers below intern_size */
+    unsigned int *free_numbers;
+
+    /* The number of unused numbers */
+    unsigned int free_count;
+
+    /* Maps each interned string to its intern */
+    hash_table_t intern_table;
+
+    /* The text blob */
+    char *text;
+
+    /* The number of bytes allocated for the text blob */
+    unsigned int text_size;
+
+    /* The offset of the first byte of the blob.  Offsets only ever
+     * increase (modulo 2^32) so that discarding old text doesn't
+     * require the columns to be rewritten. */
+    unsigned int text_origin;
+
+    /* The offset just past the last byte in use */
+    unsigned int text_end;
+};
+
+/* Allocates and initializes a new, empty message_store */
+message_store_t
+message_store_alloc(unsigned int capacity)
+{
+    message_store_t self;
+
+    /* Sanity check */
+    ASSERT(capacity != 0);
+
+    /* Allocate memory for the store */
+    self = calloc(1, sizeof(struct message_store));
+    if (self == NULL) {
+        return NULL;
+    }
+
+    /* Allocate its columns */
+    self->capacity = capacity;
+    self->infos = malloc(capacity * sizeof(unsigned int));
+    self->groups = malloc(capacity * sizeof(unsigned int));
+    self->users = malloc(capacity * sizeof(unsigned int));
+    self->texts = malloc(capacity * sizeof(unsigned int));
+    self->times = malloc(capacity * sizeof(unsigned int));
+    self->intern_table = hash_table_alloc();
+    if (self->infos == NULL || self->groups == NULL ||
+        self->users == NULL || self->texts == NULL ||
+        self->times == NULL || self->intern_table == NULL) {
+        message_store_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+/* Frees the resources consumed by the message_store */
+void
+message_store_free(message_store_t self)
+{
+    unsigned int i;
+
+    /* Free the interned strings */
+    for (i = 0; i < self->intern_size; i++) {
+        if (self->interns[i] != NULL) {
+            free(self->interns[i]);
+        }
+    }
+
+    if (self->intern_table != NULL) {
+        hash_table_free(self->intern_table);
+    }
+
+    free(self->interns);
+    free(self->free_numbers);
+    free(self->infos);
+    free(self->groups);
+    free(self->users);
+    free(self->texts);
+    free(self->times);
+    free(self->text);
+    free(self);
+}
+
+/* Returns the number of messages in the store */
+unsigned int
+message_store_count(message_store_t self)
+{
+    return self->count;
+}
+
+/* Returns the number of an interned copy of string, adding a
+ * reference to it, or NO_STRING if string is NULL.  Sets *ok_out to
+ * zero if memory couldn't be allocated. */
+static unsigned int
+intern_acquire(message_store_t self, const char *string, int *ok_out)
+{
+    intern_t intern;
+    intern_t *interns;
+    unsigned int *free_numbers;
+    unsigned int size, number;
+    size_t length;
+
+    if (string == NULL) {
+        return NO_STRING;
+    }
+
+    /* Look for an existing copy */
+    intern = hash_table_get(self->intern_table, string);
+    if (intern != NULL) {
+        intern->ref_count++;
+        return intern->number;
+    }
+
+    /* Make sure there's an unused number */
+    if (self->free_count == 0) {
+        size = MAX(self->intern_size * 2, INTERNS_MIN_SIZE);
+        interns = realloc(self->interns, size * sizeof(intern_t));
+        if (interns == NULL) {
+            *ok_out = 0;
+            return NO_STRING;
+        }
+
+        self->interns = interns;
+        free_numbers = realloc(self->free_numbers,
+                               size * sizeof(unsigned int));
+        if (free_numbers == NULL) {
+            *ok_out = 0;
+            return NO_STRING;
+        }
+
+        self->free_numbers = free_numbers;
+
+        /* Hand out the lowest new numbers first */
+        for (number = size; number > self->intern_size; number--) {
+            self->interns[number - 1] = NULL;
+            self->free_numbers[self->free_count++] = number - 1;
+        }
+
+        self->intern_size = size;
+    }
+
+    /* Make a copy of the string */
+    length = strlen(string);
+    intern = malloc(sizeof(struct intern) + length);
+    if (intern == NULL) {
+        *ok_out = 0;
+        return NO_STRING;
+    }
+
+    memcpy(intern->string, string, length + 1);
+    intern->ref_count = 1;
+    intern->number = self->free_numbers[self->free_count - 1];
+    if (hash_table_put(self->intern_table, intern->string, intern) < 0) {
+        free(intern);
+        *ok_out = 0;
+        return NO_STRING;
+    }
+
+    self->free_count--;
+    self->interns[intern->number] = intern;
+    return intern->number;
+}
+
+/* Drops a reference to an interned string, freeing it once the store
+ * no longer refers to it */
+static void
+intern_release(message_store_t self, unsigned int number)
+{
+    intern_t intern;
+
+    if (number == NO_STRING) {
+        return;
+    }
+
+    intern = self->interns[number];
+    ASSERT(intern != NULL && intern->ref_count != 0);
+    if (--intern->ref_count != 0) {
+        return;
+    }
+
+    hash_table_remove(self->intern_table, intern->string);
+    self->interns[number] = NULL;
+    self->free_numbers[self->free_count++] = number;
+    free(intern);
+}
+
+/* Returns an interned string, or NULL for NO_STRING */
+static const char *
+intern_string(message_store_t self, unsigned int number)
+{
+    if (number == NO_STRING) {
+        return NULL;
+    }
+
+    return self->interns[number]->string;
+}
+
+/* Makes sure that length more bytes can be appended to the text blob,
+ * discarding the text of messages which are no longer in the store.
+ * Returns 0 on success, -1 if memory couldn't be allocated. */
+static int
+text_reserve(message_store_t self, unsigned int length)
+{
+    unsigned int start, live, size;
+    char *text;
+
+    /* Is there room already? */
+    if (self->text_end - self->text_origin + length <= self->text_size) {
+        return 0;
+    }
+
+    /* Move the text of the messages still in the store to the
+     * beginning of the blob */
+    start = self->count == 0 ? self->text_end : self->texts[self->first];
+    live = self->text_end - start;
+    if (live + length < live) {
+        return -1;
+    }
+
+    if (live != 0) {
+        memmove(self->text, self->text + (start - self->text_origin), live);
+    }
+
+    self->text_origin = start;
+
+    /* Grow the blob if it would still be more than half full, so that
+     * we don't spend all of our time moving text around */
+    if ((live + length) * 2 <= self->text_size) {
+        return 0;
+    }
+
+    size = MAX(self->text_size, TEXT_MIN_SIZE);
+    while (size < (live + length) * 2) {
+        if (size * 2 < size) {
+            return -1;
+        }
+
+        size *= 2;
+    }
+
+    text = realloc(self->text, size);
+    if (text == NULL) {
+        return -1;
+    }
+
+    self->text = text;
+    self->text_size = size;
+    return 0;
+}
+
+/* Adds a copy of message to the store */
+int
+message_store_add(message_store_t self, message_t message)
+{
+    const char *string = message_get_string(message);
+    const char *id = message_get_id(message);
+    unsigned int info, group, user;
+    size_t string_size, id_size;
+    unsigned int slot;
+    int ok = 1;
+
+    /* Intern the short strings */
+    info = intern_acquire(self, message_get_info(message), &ok);
+    group = intern_acquire(self, message_get_group(message), &ok);
+    user = intern_acquire(self, message_get_user(message), &ok);
+
+    /* Make room for the text and id */
+    string_size = strlen(string) + 1;
+    id_size = (id == NULL) ? 1 : strlen(id) + 1;
+    if (!ok || string_size + id_size > (unsigned int)-1 ||
+        text_reserve(self, (unsigned int)(string_size + id_size)) < 0) {
+        intern_release(self, info);
+        intern_release(self, group);
+        intern_release(self, user);
+        return -1;
+    }
+
+    /* Discard the oldest message if we're full */
+    if (self->count == self->capacity) {
+        intern_release(self, self->infos[self->first]);
+        intern_release(self, self->groups[self->first]);
+        intern_release(self, self->users[self->first]);
+        self->first = (self->first + 1) % self->capacity;
+        self->count--;
+    }
+
+    /* Fill in the next slot */
+    slot = (self->first + self->count) % self->capacity;
+    self->infos[slot] = info;
+    self->groups[slot] = group;
+    self->users[slot] = user;
+    self->times[slot] = (unsigned int)*message_get_creation_time(message);
+
+    /* Append the text and id to the blob */
+    self->texts[slot] = self->text_end;
+    memcpy(self->text + (self->text_end - self->text_origin),
+           string, string_size);
+    if (id == NULL) {
+        self->text[self->text_end - self->text_origin + string_size] = '\0';
+    } else {
+        memcpy(self->text + (self->text_end - self->text_origin) +
+               string_size, id, id_size);
+    }
+
+    self->text_end += (unsigned int)(string_size + id_size);
+    self->count++;
+    return 0;
+}
+
+/* Returns a new message_t with the fields of the message at index */
+message_t
+message_store_get(message_store_t self, unsigned int index)
+{
+    message_t message;
+    const char *string;
+    const char *id;
+    unsigned int slot;
+
+    /* Sanity check */
+    ASSERT(index < self->count);
+
+    /* Find the slot's text and id */
+    slot = (self->first + index) % self->capacity;
+    string = self->text + (self->texts[slot] - self->text_origin);
+    id = string + strlen(string) + 1;
+
+    /* Rebuild the message */
+    message = message_alloc(intern_string(self, self->infos[slot]),
+                            intern_string(self, self->groups[slot]),
+                            intern_string(self, self->users[slot]),
+                            string, 0, NULL, 0, NULL,
+                            *id == '\0' ? NULL : id, NULL, NULL);
+    if (message == NULL) {
+        return NULL;
+    }
+
+    message_set_creation_time(message, (time_t)self->times[slot]);
+    return message;
+}
@@ -0,0 +1,82 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifndef MESSAGE_STORE_H
+#define MESSAGE_STORE_H
+
+/* A compact, fixed-capacity store of old messages.  Rather than
+ * keeping each message_t, the store keeps its fields in columns: the
+ * info, group and user strings are interned, the text and id are
+ * appended to a single blob, and the creation time is kept in 32
+ * bits.  Once the store is full, adding a message discards the
+ * oldest one.  Only the fields needed to display, select and reply
+ * to a message are kept; its timeout, tag, thread and attachment are
+ * dropped. */
+typedef struct message_store *message_store_t;
+
+/* Allocates and initializes a new, empty message_store which can
+ * hold up to capacity messages */
+message_store_t
+message_store_alloc(unsigned int capacity);
+
+
+/* Frees the resources consumed by the message_store */
+void
+message_store_free(message_store_t self);
+
+
+/* Returns the number of messages in the store */
+unsigned int
+message_store_count(message_store_t self);
+
+
+/* Adds a copy of message to the store, discarding the oldest message
+ * if the store is full.  Returns 0 on success, -1 if memory couldn't
+ * be allocated. */
+int
+message_store_add(message_store_t self, message_t message);
+
+
+/* Returns a new message_t with the fields of the message at index,
+ * where the oldest message has index 0, or NULL if memory couldn't be
+ * allocated.  The caller is responsible for freeing it. */
+message_t
+message_store_get(message_store_t self, unsigned int index);
+
+#endif /* MESSAGE_STORE_H */
@@ -105,6 +105,13 @@ struct message_view {
     /* Dimensions of the time string */
     struct string_sizes timestamp_sizes;
 
+    /* The strings encoded in the renderer's font */
+    utf8_text_t timestamp_text;
+    utf8_text_t group_text;
+    utf8_text_t user_text;
+    utf8_text_t message_text;
+    utf8_text_t separator_text;
+
     /* Dimensions of the group string */
     struct string_sizes group_sizes;
 
@@ -140,22 +147,19 @@ rect_overlaps(XRectangle *rect, long left, long top, long right, long bottom)
     return 1;
 }
 
-/* Draws a string in the appropriate color with optional underline */
+/* Draws a string with optional underline in the GC's foreground color */
 static void
 paint_string(Display *display,
              Drawable drawable,
              GC gc,
-             unsigned long pixel,
              long x,
              long y,
              XRectangle *bbox,
              string_sizes_t sizes,
              utf8_renderer_t renderer,
-             const char *string,
+             utf8_text_t text,
              Bool has_underline)
 {
-    XGCValues values;
-
     /* Is the string visible? */
     if (rect_overlaps(bbox,
                       x + sizes->lbearing, y - sizes->ascent,
@@ -164,14 +168,10 @@ paint_string(Display *display,
                                         x, y - sizes->ascent,
                                         x + sizes->width,
                                         y + sizes->descent))) {
-        /* Set the foreground color */
-        /* FIX THIS: do we just assume that the font is set? */
-        values.foreground = pixel;
-        XChangeGC(display, gc, GCForeground, &values);
-
         /* Draw the string */
-        utf8_renderer_draw_string(display, drawable, gc, renderer,
-                                  x, y, bbox, string);
+        /* FIX THIS: do we just assume that the font is set? */
+        utf8_renderer_draw_text(display, drawable, gc, renderer,
+                                x, y, bbox, text);
 
         /* Draw the underline */
         if (has_underline) {
@@ -233,17 +233,27 @@ message_view_alloc(message_t message, long indent, utf8_renderer_t renderer)
     utf8_renderer_measure_string(renderer, INDENT, &sizes);
     self->indent_width = sizes.width;
 
-    /* Measure the message's strings */
-    utf8_renderer_measure_string(renderer, self->timestamp,
-                                 &self->timestamp_sizes);
-    utf8_renderer_measure_string(renderer, message_get_group(message),
-                                 &self->group_sizes);
-    utf8_renderer_measure_string(renderer, message_get_user(message),
-                                 &self->user_sizes);
-    utf8_renderer_measure_string(renderer, message_get_string(message),
-                                 &self->message_sizes);
-    utf8_renderer_measure_string(renderer, SEPARATOR,
-                                 &self->separator_sizes);
+    /* Encode and measure the message's strings once so that painting
+     * doesn't have to convert them.  The renderer shares the encodings
+     * of short strings, so the separator is only encoded once and
+     * most timestamps, groups and users are too. */
+    self->timestamp_text = utf8_renderer_encode(
+        renderer, self->timestamp, &self->timestamp_sizes);
+    self->group_text = utf8_renderer_encode(
+        renderer, message_get_group(message), &self->group_sizes);
+    self->user_text = utf8_renderer_encode(
+        renderer, message_get_user(message), &self->user_sizes);
+    self->message_text = utf8_renderer_encode(
+        renderer, message_get_string(message), &self->message_sizes);
+    self->separator_text = utf8_renderer_encode(
+        renderer, SEPARATOR, &self->separator_sizes);
+    if (self->timestamp_text == NULL || self->group_text == NULL ||
+        self->user_text == NULL || self->message_text == NULL ||
+        self->separator_text == NULL) {
+        message_view_free(self);
+        return NULL;
+    }
+
     return self;
 }
 
@@ -254,6 +264,13 @@ message_view_free(message_view_t self)
     /* Free our reference to the message */
     MESSAGE_FREE_REF(self->message, ref_message_view, self);
 
+    /* Free the encoded strings */
+    utf8_text_free(self->timestamp_text);
+    utf8_text_free(self->group_text);
+    utf8_text_free(self->user_text);
+    utf8_text_free(self->message_text);
+    utf8_text_free(self->separator_text);
+
     /* Free the message_view itself */
     free(self);
 }
@@ -265,6 +282,49 @@ message_view_get_message(message_view_t self)
     return self->message;
 }
 
+/* Returns the width of a message's view without any indentation or
+ * timestamp */
+long
+message_view_measure(message_t message, utf8_renderer_t renderer)
+{
+    struct string_sizes sizes;
+    long width;
+
+    /* The separator appears twice */
+    utf8_renderer_measure_string(renderer, SEPARATOR, &sizes);
+    width = sizes.width * 2;
+
+    utf8_renderer_measure_string(renderer, message_get_group(message), &sizes);
+    width += sizes.width;
+    utf8_renderer_measure_string(renderer, message_get_user(message), &sizes);
+    width += sizes.width;
+    utf8_renderer_measure_string(renderer, message_get_string(message),
+                                 &sizes);
+    return width + sizes.width;
+}
+
+/* Returns the width of one level of indentation */
+long
+message_view_indent_width(utf8_renderer_t renderer)
+{
+    struct string_sizes sizes;
+
+    utf8_renderer_measure_string(renderer, INDENT, &sizes);
+    return sizes.width;
+}
+
+/* Returns the width that showing the timestamp adds to every view.
+ * Timestamps are right-justified in the space taken by the widest
+ * one and followed by an indent. */
+long
+message_view_timestamp_width(utf8_renderer_t renderer)
+{
+    struct string_sizes sizes;
+
+    utf8_renderer_measure_string(renderer, NOON_TIMESTAMP, &sizes);
+    return sizes.width + message_view_indent_width(renderer);
+}
+
 /* Returns the sizes of the message view */
 void
 message_view_get_sizes(message_view_t self,
@@ -322,6 +382,134 @@ message_view_get_sizes(message_view_t self,
     sizes_out->descent = self->separator_sizes.descent;
 }
 
+/* Draws the parts of the message_view which are painted in pixel.
+ * The GC's foreground must already be set to pixel. */
+void
+message_view_paint_pixel(message_view_t self,
+                         Display *display,
+                         Drawable drawable,
+                         GC gc,
+                         int show_timestamp,
+                         unsigned long pixel,
+                         unsigned long timestamp_pixel,
+                         unsigned long group_pixel,
+                         unsigned long user_pixel,
+                         unsigned long message_pixel,
+                         unsigned long separator_pixel,
+                         long x,
+                         long y,
+                         XRectangle *bbox)
+{
+    /* Paint the timestamp */
+    if (show_timestamp) {
+        /* Go to the end of the timestamp */
+        x += self->noon_width;
+
+        /* Draw the timestamp right justified */
+        if (timestamp_pixel == pixel) {
+            paint_string(display, drawable, gc,
+                         x - self->timestamp_sizes.width, y,
+                         bbox, &self->timestamp_sizes,
+                         self->renderer, self->timestamp_text, False);
+        }
+
+        /* Indent the next bit */
+        x += self->indent_width;
+    }
+
+    /* Indent */
+    x += self->indent * self->indent_width;
+
+    /* Paint the group string */
+    if (group_pixel == pixel) {
+        paint_string(display, drawable, gc,
+                     x, y, bbox, &self->group_sizes,
+                     self->renderer, self->group_text,
+                     self->has_underline);
+    }
+    x += self->group_sizes.width;
+
+    /* Paint the first separator */
+    if (separator_pixel == pixel) {
+        paint_string(display, drawable, gc,
+                     x, y, bbox, &self->separator_sizes,
+                     self->renderer, self->separator_text,
+                     self->has_underline);
+    }
+    x += self->separator_sizes.width;
+
+    /* Paint the user string */
+    if (user_pixel == pixel) {
+        paint_string(display, drawable, gc,
+                     x, y, bbox, &self->user_sizes,
+                     self->renderer, self->user_text,
+                     self->has_underline);
+    }
+    x += self->user_sizes.width;
+
+    /* Paint the second separator */
+    if (separator_pixel == pixel) {
+        paint_string(display, drawable, gc,
+                     x, y, bbox, &self->separator_sizes,
+                     self->renderer, self->separator_text,
+                     self->has_underline);
+    }
+    x += self->separator_sizes.width;
+
+    /* Paint the message string */
+    if (message_pixel == pixel) {
+        paint_string(display, drawable, gc,
+                     x, y, bbox, &self->message_sizes,
+                     self->renderer, self->message_text,
+                     self->has_underline);
+    }
+}
+
+/* Fills pixels_out with the distinct colors used to paint a view in
+ * the order in which they should be painted and returns how many
+ * there are */
+int
+message_view_pixels(int show_timestamp,
+                    unsigned long timestamp_pixel,
+                    unsigned long group_pixel,
+                    unsigned long user_pixel,
+                    unsigned long message_pixel,
+                    unsigned long separator_pixel,
+                    unsigned long *pixels_out)
+{
+    unsigned long pixels[MESSAGE_VIEW_PIXEL_COUNT];
+    int count = 0;
+    int i, j;
+
+    /* List the pixels in the order the parts appear */
+    if (show_timestamp) {
+        pixels[count++] = timestamp_pixel;
+    }
+
+    pixels[count++] = group_pixel;
+    pixels[count++] = separator_pixel;
+    pixels[count++] = user_pixel;
+    pixels[count++] = message_pixel;
+
+    /* Skip any we've already seen */
+    j = 0;
+    for (i = 0; i < count; i++) {
+        int k;
+
+        for (k = 0; k < j; k++) {
+            if (pixels_out[k] == pixels[i]) {
+                break;
+            }
+        }
+
+        if (k == j) {
+            pixels_out[j++] = pixels[i];
+        }
+    }
+
+    return j;
+}
+
 /* Draws the message_view */
 void
 message_view_paint(message_view_t self,
@@ -338,8 +526,10 @@ message_view_paint(message_view_t self,
                    long y,
                    XRectangle *bbox)
 {
-#if (DEBUG_PER_CHAR - 1) == 0
+    unsigned long pixels[MESSAGE_VIEW_PIXEL_COUNT];
     XGCValues values;
+    int count, i;
+#if (DEBUG_PER_CHAR - 1) == 0
     const char *string;
     long px;
 #endif /* DEBUG_PER_CHAR */
@@ -383,58 +573,21 @@ message_view_paint(message_view_t self,
     }
 #endif /* DEBUG_PER_CHAR */
 
-    /* Paint the timestamp */
-    if (show_timestamp) {
-        /* Go to the end of the timestamp */
-        x += self->noon_width;
-
-        /* Draw the timestamp right justified */
-        paint_string(display, drawable, gc, timestamp_pixel,
-                     x - self->timestamp_sizes.width, y,
-                     bbox, &self->timestamp_sizes,
-                     self->renderer, self->timestamp, False);
+    /* Paint each color in turn so that the GC only changes once per
+     * color rather than once per string */
+    count = message_view_pixels(show_timestamp, timestamp_pixel,
+                                group_pixel, user_pixel, message_pixel,
+                                separator_pixel, pixels);
+    for (i = 0; i < count; i++) {
+        values.foreground = pixels[i];
+        XChangeGC(display, gc, GCForeground, &values);
 
-        /* Indent the next bit */
-        x += self->indent_width;
+        message_view_paint_pixel(self, display, drawable, gc,
+                                 show_timestamp, pixels[i],
+                                 timestamp_pixel, group_pixel, user_pixel,
+                                 message_pixel, separator_pixel,
+                                 x, y, bbox);
     }
-
-    /* Indent */
-    x += self->indent * self->indent_width;
-
-    /* Paint the group string */
-    paint_string(display, drawable, gc, group_pixel,
-                 x, y, bbox, &self->group_sizes,
-                 self->renderer, message_get_group(self->message),
-                 self->has_underline);
-    x += self->group_sizes.width;
-
-    /* Paint the first separator */
-    paint_string(display, drawable, gc, separator_pixel,
-                 x, y, bbox, &self->separator_sizes,
-                 self->renderer, SEPARATOR,
-                 self->has_underline);
-    x += self->separator_sizes.width;
-
-    /* Paint the user string */
-    paint_string(display, drawable, gc, user_pixel,
-                 x, y, bbox, &self->user_sizes,
-                 self->renderer, message_get_user(self->message),
-                 self->has_underline);
-    x += self->user_sizes.width;
-
-    /* Paint the second separator */
-    paint_string(display, drawable, gc, separator_pixel,
-                 x, y, bbox, &self->separator_sizes,
-                 self->renderer, SEPARATOR,
-                 self->has_underline);
-    x += self->separator_sizes.width;
-
-    /* Paint the message string */
-    paint_string(display, drawable, gc, message_pixel,
-                 x, y, bbox, &self->message_sizes,
-                 self->renderer, message_get_string(self->message),
-                 self->has_underline);
-    x += self->message_sizes.width;
 }
 
 /**********************************************************************/
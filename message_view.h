@@ -40,6 +40,9 @@
 #ifndef MESSAGE_VIEW_H
 #define MESSAGE_VIEW_H
 
+/* The most colors used to paint a message_view */
+#define MESSAGE_VIEW_PIXEL_COUNT 5
+
 /* The message_view type */
 typedef struct message_view *message_view_t;
 
@@ -58,6 +61,22 @@ message_t
 message_view_get_message(message_view_t self);
 
 
+/* Returns the width of a message's view without any indentation or
+ * timestamp.  This is much cheaper than allocating a view. */
+long
+message_view_measure(message_t message, utf8_renderer_t renderer);
+
+
+/* Returns the width of one level of indentation */
+long
+message_view_indent_width(utf8_renderer_t renderer);
+
+
+/* Returns the width that showing the timestamp adds to every view */
+long
+message_view_timestamp_width(utf8_renderer_t renderer);
+
+
 /* Returns the sizes of the message view */
 void
 message_view_get_sizes(message_view_t self,
@@ -82,4 +101,38 @@ message_view_paint(message_view_t self,
                    XRectangle *bbox);
 
 
+/* Fills pixels_out, which must have room for MESSAGE_VIEW_PIXEL_COUNT
+ * entries, with the distinct colors used to paint a view in the order
+ * in which they should be painted.  Returns how many there are. */
+int
+message_view_pixels(int show_timestamp,
+                    unsigned long timestamp_pixel,
+                    unsigned long group_pixel,
+                    unsigned long user_pixel,
+                    unsigned long message_pixel,
+                    unsigned long separator_pixel,
+                    unsigned long *pixels_out);
+
+
+/* Draws only the parts of the message_view which are painted in
+ * pixel.  The GC's foreground must already be set to pixel.  Painting
+ * one color across many views before moving on to the next saves
+ * changing the GC for every string of every view. */
+void
+message_view_paint_pixel(message_view_t self,
+                         Display *display,
+                         Drawable drawable,
+                         GC gc,
+                         int show_timestamp,
+                         unsigned long pixel,
+                         unsigned long timestamp_pixel,
+                         unsigned long group_pixel,
+                         unsigned long user_pixel,
+                         unsigned long message_pixel,
+                         unsigned long separator_pixel,
+                         long x,
+                         long y,
+                         XRectangle *bbox);
+
+
 #endif /* MESSAGE_VIEW_H */
@@ -252,6 +252,12 @@ struct control_panel {
     /* The receiver's history list widget */
     Widget history;
 
+    /* The receiver's history search text widget */
+    Widget search;
+
+    /* The utf8 encoder for the search widget */
+    utf8_encoder_t search_encoder;
+
     /* The status line widget */
     Widget status_line;
 
@@ -844,6 +850,88 @@ history_motion_callback(Widget widget, XtPointer closure, XtPointer call_data)
     control_panel_set_status_message(self, message);
 }
 
+/* This is called when the user hits Return in the search field */
+static void
+action_search(Widget widget, XtPointer closure, XtPointer call_data)
+{
+    control_panel_t self = (control_panel_t)closure;
+    char buffer[BUFFER_SIZE];
+    char *raw;
+    char *query;
+    size_t length;
+
+    /* Get the query and encode it in UTF8, on the stack if it fits */
+    raw = XmTextFieldGetString(self->search);
+    length = utf8_encoder_encode_into(self->search_encoder, raw,
+                                      buffer, sizeof(buffer));
+    if (length == (size_t)-1) {
+        query = NULL;
+    } else if (length <= sizeof(buffer)) {
+        query = buffer;
+    } else {
+        query = utf8_encoder_encode(self->search_encoder, raw);
+    }
+
+    XtFree(raw);
+    if (query == NULL) {
+        return;
+    }
+
+    /* Select the next matching message, or beep if there isn't one */
+    if (HistorySearch(self->history, query) == NULL) {
+        XBell(XtDisplay(widget), 0);
+    }
+
+    if (query != buffer) {
+        free(query);
+    }
+}
+
+/* Constructs the history search field */
+static void
+create_search_box(control_panel_t self, Widget parent)
+{
+    Widget form, label;
+    TextWidgetRec rc;
+
+    /* Create a layout manager for the label and text field */
+    form = XtVaCreateWidget("searchForm", xmFormWidgetClass, parent,
+                            XmNleftAttachment, XmATTACH_FORM,
+                            XmNrightAttachment, XmATTACH_FORM,
+                            XmNtopAttachment, XmATTACH_FORM,
+                            NULL);
+
+    /* The "Search" label */
+    label = XtVaCreateManagedWidget(
+        "searchLabel", xmLabelWidgetClass, form,
+        XmNleftAttachment, XmATTACH_FORM,
+        XmNtopAttachment, XmATTACH_FORM,
+        XmNbottomAttachment, XmATTACH_FORM,
+        NULL);
+
+    /* The search text field */
+    self->search = XtVaCreateManagedWidget(
+        "search", xmTextFieldWidgetClass, form,
+        XmNtraversalOn, True,
+        XmNleftAttachment, XmATTACH_WIDGET,
+        XmNrightAttachment, XmATTACH_FORM,
+        XmNleftWidget, label,
+        NULL);
+
+    /* Read the resources for the search's text widget */
+    XtGetApplicationResources(self->search, &rc,
+                              resources, XtNumber(resources),
+                              NULL, 0);
+    self->search_encoder = utf8_encoder_alloc(XtDisplay(parent),
+                                              rc.font_list, rc.code_set);
+
+    /* Search the history when the user hits Return */
+    XtAddCallback(self->search, XmNactivateCallback, action_search, self);
+
+    /* Manage the form widget now that all of its children are created */
+    XtManageChild(form);
+}
+
 /* Constructs the history list */
 static void
 create_history_box(control_panel_t self, Widget parent)
@@ -855,7 +943,8 @@ create_history_box(control_panel_t self, Widget parent)
         "historySW", xmScrolledWindowWidgetClass, parent,
         XmNleftAttachment, XmATTACH_FORM,
         XmNrightAttachment, XmATTACH_FORM,
-        XmNtopAttachment, XmATTACH_FORM,
+        XmNtopAttachment, XmATTACH_WIDGET,
+        XmNtopWidget, XtParent(self->search),
         XmNbottomAttachment, XmATTACH_WIDGET,
         XmNbottomWidget, XtParent(self->status_line),
         XmNscrollingPolicy, XmAPPLICATION_DEFINED,
@@ -1305,6 +1394,9 @@ init_ui(control_panel_t self, Widget parent)
     /* Create the status line */
     create_status_line(self, self->history_form);
 
+    /* And the search field */
+    create_search_box(self, self->history_form);
+
     /* And the history box */
     create_history_box(self, self->history_form);
 
@@ -1348,9 +1440,16 @@ set_group_selection(control_panel_t self, menu_item_tuple_t tuple)
 static void
 set_user(control_panel_t self, const char *user)
 {
+    char buffer[BUFFER_SIZE];
     char *raw;
 
     /* Convert the string into the font's code set */
+    if (utf8_encoder_decode_into(self->user_encoder, user,
+                                 buffer, sizeof(buffer)) <= sizeof(buffer)) {
+        XmTextSetString(self->user, buffer);
+        return;
+    }
+
     raw = utf8_encoder_decode(self->user_encoder, user);
     XmTextSetString(self->user, raw);
     free(raw);
@@ -1378,9 +1477,16 @@ get_user(control_panel_t self)
 static void
 set_text(control_panel_t self, const char *text)
 {
+    char buffer[BUFFER_SIZE];
     char *raw;
 
     /* Convert the string to the font's code set */
+    if (utf8_encoder_decode_into(self->text_encoder, text,
+                                 buffer, sizeof(buffer)) <= sizeof(buffer)) {
+        XmTextSetString(self->text, buffer);
+        return;
+    }
+
     raw = utf8_encoder_decode(self->text_encoder, text);
     XmTextSetString(self->text, raw);
     free(raw);
@@ -1500,9 +1606,16 @@ get_mime_type(control_panel_t self)
 static void
 set_mime_args(control_panel_t self, const char *args)
 {
+    char buffer[BUFFER_SIZE];
     char *raw;
 
     /* Convert the string to the font's code set */
+    if (utf8_encoder_decode_into(self->mime_encoder, args,
+                                 buffer, sizeof(buffer)) <= sizeof(buffer)) {
+        XmTextSetString(self->mime_args, buffer);
+        return;
+    }
+
     raw = utf8_encoder_decode(self->mime_encoder, args);
     XmTextSetString(self->mime_args, raw);
     free(raw);
@@ -0,0 +1,385 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h> /* free, malloc, realloc */
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h> /* memcpy, memmove, strlen */
+#endif
+#ifdef HAVE_ASSERT_H
+# include <assert.h> /* assert */
+#endif
+#include "replace.h"
+#include "globals.h"
+#include "hash_table.h"
+#include "search_index.h"
+
+/* The longest word worth telling apart from longer ones */
+#define WORD_MAX 64
+
+/* The most words of a query which are used */
+#define QUERY_MAX 16
+
+/* The smallest list of ids worth allocating */
+#define IDS_MIN_SIZE 4
+
+/* Answers non-zero if the byte is part of a word */
+#define IS_WORD_BYTE(ch) \
+    (('a' <= (ch) && (ch) <= 'z') || ('A' <= (ch) && (ch) <= 'Z') || \
+     ('0' <= (ch) && (ch) <= '9') || 0x80 <= (ch))
+
+/* Folds ASCII upper case to lower case */
+#define FOLD(ch) (('A' <= (ch) && (ch) <= 'Z') ? (ch) - 'A' + 'a' : (ch))
+
+/* The documents which contain a word */
+typedef struct posting *posting_t;
+struct posting {
+    /* The previous and next postings, so that they can all be freed */
+    posting_t prev;
+    posting_t next;
+
+    /* The ids of the documents, oldest first, starting at start */
+    unsigned long *ids;
+
+    /* The position of the oldest id in ids */
+    unsigned int start;
+
+    /* The number of ids */
+    unsigned int count;
+
+    /* The number of ids which fit in ids */
+    unsigned int size;
+
+    /* The word, which is also the posting's key in the table */
+    char word[1];
+};
+
+/* The structure of a search index */
+struct search_index {
+    /* The postings indexed by word */
+    hash_table_t table;
+
+    /* All of the postings */
+    posting_t postings;
+};
+
+/* Copies the next word of string into word, folding its case and
+ * truncating it to WORD_MAX bytes.  Returns a pointer to the rest of
+ * the string, or NULL if there are no more words. */
+static const char *
+next_word(const char *string, char *word)
+{
+    const unsigned char *point = (const unsigned char *)string;
+    size_t length = 0;
+
+    /* Skip to the start of the word */
+    while (*point != '\0' && !IS_WORD_BYTE(*point)) {
+        point++;
+    }
+
+    if (*point == '\0') {
+        return NULL;
+    }
+
+    /* Copy it */
+    while (IS_WORD_BYTE(*point)) {
+        if (length < WORD_MAX) {
+            word[length++] = FOLD(*point);
+        }
+
+        point++;
+    }
+
+    word[length] = '\0';
+    return (const char *)point;
+}
+
+/* Returns the index of the first of a posting's ids which isn't less
+ * than id, or its count if they all are */
+static unsigned int
+posting_search(posting_t self, unsigned long id)
+{
+    unsigned long *ids = self->ids + self->start;
+    unsigned int low = 0;
+    unsigned int high = self->count;
+    unsigned int middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (ids[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/* Allocates and initializes a new, empty search_index */
+search_index_t
+search_index_alloc(void)
+{
+    search_index_t self;
+
+    self = malloc(sizeof(struct search_index));
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->table = hash_table_alloc();
+    if (self->table == NULL) {
+        free(self);
+        return NULL;
+    }
+
+    self->postings = NULL;
+    return self;
+}
+
+/* Frees the resources consumed by the search_index */
+void
+search_index_free(search_index_t self)
+{
+    posting_t posting;
+
+    while (self->postings != NULL) {
+        posting = self->postings;
+        self->postings = posting->next;
+        free(posting->ids);
+        free(posting);
+    }
+
+    hash_table_free(self->table);
+    free(self);
+}
+
+/* Records that the document with the given id contains the words of
+ * string */
+int
+search_index_add(search_index_t self, unsigned long id, const char *string)
+{
+    char word[WORD_MAX + 1];
+    posting_t posting;
+    unsigned long *ids;
+    size_t length;
+    unsigned int size;
+
+    if (string == NULL) {
+        return 0;
+    }
+
+    while ((string = next_word(string, word)) != NULL) {
+        posting = hash_table_get(self->table, word);
+        if (posting == NULL) {
+            /* Start a new posting for the word */
+            length = strlen(word);
+            posting = malloc(sizeof(struct posting) + length);
+            if (posting == NULL) {
+                return -1;
+            }
+
+            memcpy(posting->word, word, length + 1);
+            posting->ids = NULL;
+            posting->start = 0;
+            posting->count = 0;
+            posting->size = 0;
+
+            if (hash_table_put(self->table, posting->word, posting) < 0) {
+                free(posting);
+                return -1;
+            }
+
+            posting->prev = NULL;
+            posting->next = self->postings;
+            if (self->postings != NULL) {
+                self->postings->prev = posting;
+            }
+            self->postings = posting;
+        } else if (posting->ids[posting->start + posting->count - 1] == id) {
+            /* The document already contains the word */
+            continue;
+        }
+
+        /* Sanity check */
+        ASSERT(posting->count == 0 ||
+               posting->ids[posting->start + posting->count - 1] < id);
+
+        /* Make room at the end of the list */
+        if (posting->start + posting->count == posting->size) {
+            if (posting->start != 0) {
+                /* Slide the ids down over the ones we've removed */
+                memmove(posting->ids, posting->ids + posting->start,
+                        posting->count * sizeof(unsigned long));
+                posting->start = 0;
+            } else {
+                /* Grow the list */
+                size = posting->size < IDS_MIN_SIZE ?
+                    IDS_MIN_SIZE : posting->size * 2;
+                ids = realloc(posting->ids, size * sizeof(unsigned long));
+                if (ids == NULL) {
+                    return -1;
+                }
+
+                posting->ids = ids;
+                posting->size = size;
+            }
+        }
+
+        posting->ids[posting->start + posting->count] = id;
+        posting->count++;
+    }
+
+    return 0;
+}
+
+/* Forgets that the document with the given id contains the words of
+ * string */
+void
+search_index_remove(search_index_t self,
+                    unsigned long id,
+                    const char *string)
+{
+    char word[WORD_MAX + 1];
+    posting_t posting;
+
+    if (string == NULL) {
+        return;
+    }
+
+    while ((string = next_word(string, word)) != NULL) {
+        /* Skip words we've already removed the document from */
+        posting = hash_table_get(self->table, word);
+        if (posting == NULL || posting->ids[posting->start] != id) {
+            continue;
+        }
+
+        /* The oldest document is always at the front */
+        posting->start++;
+        posting->count--;
+        if (posting->count != 0) {
+            continue;
+        }
+
+        /* Nothing contains the word any more */
+        hash_table_remove(self->table, posting->word);
+        if (posting->prev == NULL) {
+            self->postings = posting->next;
+        } else {
+            posting->prev->next = posting->next;
+        }
+
+        if (posting->next != NULL) {
+            posting->next->prev = posting->prev;
+        }
+
+        free(posting->ids);
+        free(posting);
+    }
+}
+
+/* Finds the newest document with an id less than before which
+ * contains every word of query */
+int
+search_index_find(search_index_t self,
+                  const char *query,
+                  unsigned long before,
+                  unsigned long *id_out)
+{
+    char word[WORD_MAX + 1];
+    posting_t postings[QUERY_MAX];
+    posting_t shortest;
+    unsigned long id;
+    unsigned int count = 0;
+    unsigned int index;
+    unsigned int i, j;
+
+    /* Look up each word of the query */
+    while (count < QUERY_MAX &&
+           (query = next_word(query, word)) != NULL) {
+        postings[count] = hash_table_get(self->table, word);
+        if (postings[count] == NULL) {
+            return -1;
+        }
+
+        count++;
+    }
+
+    /* An empty query matches nothing */
+    if (count == 0) {
+        return -1;
+    }
+
+    /* Walk back through the shortest list */
+    shortest = postings[0];
+    for (i = 1; i < count; i++) {
+        if (postings[i]->count < shortest->count) {
+            shortest = postings[i];
+        }
+    }
+
+    index = posting_search(shortest, before);
+    while (index != 0) {
+        index--;
+        id = shortest->ids[shortest->start + index];
+
+        /* Does every other word appear in the document? */
+        for (i = 0; i < count; i++) {
+            if (postings[i] != shortest) {
+                j = posting_search(postings[i], id);
+                if (j == postings[i]->count ||
+                    postings[i]->ids[postings[i]->start + j] != id) {
+                    break;
+                }
+            }
+        }
+
+        if (i == count) {
+            *id_out = id;
+            return 0;
+        }
+    }
+
+    return -1;
+}
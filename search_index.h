@@ -0,0 +1,86 @@
+/* -*- mode: c; c-file-style: "elvin" -*- */
+/***********************************************************************
+
+  Copyright (C) 1997-2009 by Mantara Software (ABN 17 105 665 594).
+  All Rights Reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above
+     copyright notice, this list of conditions and the following
+     disclaimer.
+
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials
+     provided with the distribution.
+
+   * Neither the name of the Mantara Software nor the names
+     of its contributors may be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+***********************************************************************/
+
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+/* An inverted index from words to the ids of the documents which
+ * contain them.  A word is a run of letters, digits and non-ASCII
+ * bytes, compared without regard to ASCII case.  Documents must be
+ * added in order of increasing id and removed oldest first, which
+ * keeps every word's list of ids sorted and lets removal pop the
+ * front of each list. */
+typedef struct search_index *search_index_t;
+
+/* Allocates and initializes a new, empty search_index */
+search_index_t
+search_index_alloc(void);
+
+
+/* Frees the resources consumed by the search_index */
+void
+search_index_free(search_index_t self);
+
+
+/* Records that the document with the given id contains the words of
+ * string.  A document may be added in several strings as long as no
+ * newer document has been added in between.  Returns 0 on success,
+ * -1 if memory couldn't be allocated. */
+int
+search_index_add(search_index_t self, unsigned long id, const char *string);
+
+
+/* Forgets that the document with the given id contains the words of
+ * string.  The document must be the oldest one in the index. */
+void
+search_index_remove(search_index_t self,
+                    unsigned long id,
+                    const char *string);
+
+
+/* Finds the newest document with an id less than before which
+ * contains every word of query.  Returns 0 and sets id_out on
+ * success, -1 if there is no such document. */
+int
+search_index_find(search_index_t self,
+                  const char *query,
+                  unsigned long before,
+                  unsigned long *id_out);
+
+#endif /* SEARCH_INDEX_H */
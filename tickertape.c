@@ -78,6 +78,7 @@
 #include "replace.h"
 /*#include "errors.h"*/
 #include "message.h"
+#include "message_log.h"
 #include "tickertape.h"
 #include "Scroller.h"
 #include "panel.h"
@@ -100,6 +101,7 @@
 #define DEFAULT_GROUPS_FILE "groups"
 #define DEFAULT_USENET_FILE "usenet"
 #define DEFAULT_KEYS_FILE "keys"
+#define DEFAULT_HISTORY_LOG "history"
 
 #define METAMAIL_OPTIONS "-x", "-B", "-q"
 
@@ -194,6 +196,9 @@ struct tickertape {
     /* The receiver's mail subscription */
     mail_sub_t mail_sub;
 
+    /* The log of received messages, or NULL if we're not keeping one */
+    message_log_t history_log;
+
     /* The control panel */
     control_panel_t control_panel;
 
@@ -215,6 +220,8 @@ static const char *
 tickertape_keys_filename(tickertape_t self);
 static const char *
 tickertape_keys_directory(tickertape_t self);
+static void
+open_history_log(tickertape_t self);
 
 
 /*
@@ -334,6 +341,11 @@ receive_callback(void *rock, message_t message, int show_attachment)
      * killed if it is added to a thread which has been killed */
     control_panel_add_message(self->control_panel, message);
 
+    /* Record it so that it's still in the history after a restart */
+    if (self->history_log != NULL) {
+        message_log_append(self->history_log, message);
+    }
+
     /* Add the message to the scroller if it hasn't been killed */
     if (!message_is_killed(message)) {
         ScAddMessage(self->scroller, message);
@@ -1319,6 +1331,7 @@ tickertape_alloc(XTickertapeRec *resources,
     self->groups_count = 0;
     self->usenet_sub = NULL;
     self->mail_sub = NULL;
+    self->history_log = NULL;
     self->control_panel = NULL;
     self->scroller = NULL;
 
@@ -1343,6 +1356,9 @@ tickertape_alloc(XTickertapeRec *resources,
     /* Draw the user interface */
     init_ui(self);
 
+    /* Restore the history from the last time we ran */
+    open_history_log(self);
+
     /* Set the handle's status callback */
     if (!elvin_handle_set_status_cb(handle, status_cb, self, self->error)) {
         eeprintf(error, "elvin_handle_set_status_cb failed\n");
@@ -1408,6 +1424,10 @@ tickertape_free(tickertape_t self)
         key_table_free(self->keys);
     }
 
+    if (self->history_log != NULL) {
+        message_log_close(self->history_log);
+    }
+
     if (self->control_panel) {
         control_panel_free(self->control_panel);
     }
@@ -1581,6 +1601,53 @@ tickertape_keys_directory(tickertape_t self)
     return self->keys_dir;
 }
 
+/* Adds a message from the history log to the history */
+static void
+replay_callback(void *rock, message_t message)
+{
+    tickertape_t self = (tickertape_t)rock;
+
+    MESSAGE_ALLOC_REF(message, ref_recursion, self);
+    control_panel_add_message(self->control_panel, message);
+    MESSAGE_FREE_REF(message, ref_recursion, self);
+}
+
+/* Opens the history log, if we're keeping one, and adds the messages
+ * it recorded last time to the history */
+static void
+open_history_log(tickertape_t self)
+{
+    const char *dir;
+    char *filename;
+    size_t length;
+
+    /* Bail if we're not keeping a log */
+    if (self->resources->history_log_count <= 0 ||
+        self->control_panel == NULL) {
+        return;
+    }
+
+    /* The log lives in the ticker directory */
+    dir = tickertape_ticker_dir(self);
+    length = strlen(dir) + sizeof(DEFAULT_HISTORY_LOG) + 1;
+    filename = malloc(length);
+    if (filename == NULL) {
+        perror("unable to allocate memory");
+        exit(1);
+    }
+
+    snprintf(filename, length, "%s/%s", dir, DEFAULT_HISTORY_LOG);
+    self->history_log = message_log_open(
+        filename, (unsigned long)self->resources->history_log_count);
+    free(filename);
+    if (self->history_log == NULL) {
+        return;
+    }
+
+    /* Replay it */
+    message_log_replay(self->history_log, replay_callback, self);
+}
+
 /* Displays a message's MIME attachment */
 int
 tickertape_show_attachment(tickertape_t self, message_t message)
@@ -61,6 +61,10 @@ typedef struct {
 
     /* The number of messages to record in the send history */
     int send_history_count;
+
+    /* The number of received messages to keep in the history log, or
+     * 0 not to keep one */
+    int history_log_count;
 } XTickertapeRec;
 
 /* Answers a new Tickertape for the given user using the given file as
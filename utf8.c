@@ -46,6 +46,9 @@
 #ifdef HAVE_STDLIB_H
 # include <stdlib.h>
 #endif
+#ifdef HAVE_STRING_H
+# include <string.h> /* memcmp, memcpy, strlen */
+#endif
 #ifdef HAVE_ICONV_H
 # include <iconv.h>
 #endif
@@ -55,8 +58,17 @@
 #ifdef HAVE_ASSERT_H
 # include <assert.h>
 #endif
+#if defined(__AVX2__)
+# include <immintrin.h> /* _mm256_loadu_si256, _mm256_movemask_epi8 */
+#elif defined(__SSE2__)
+# include <emmintrin.h> /* _mm_loadu_si128, _mm_movemask_epi8 */
+#endif
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
+#if defined(HAVE_X11_XFT_XFT_H) && defined(HAVE_LIBXFT)
+# define USE_XFT 1
+# include <X11/Xft/Xft.h>
+#endif
 #include "globals.h"
 #include "utils.h"
 #include "utf8.h"
@@ -76,6 +88,27 @@
 /* The maximum number of bytes per character */
 #define MAX_CHAR_SIZE 2
 
+/* The number of measurements a renderer remembers */
+#define MEMO_SIZE 128
+
+/* The longest string whose measurements are remembered.  This covers
+ * separators, timestamps and most group and user names. */
+#define MEMO_STRING_MAX 31
+
+/* The number of characters in a page of character measurements, and
+ * the number of pages needed to cover a 16-bit font */
+#define PAGE_SIZE 256
+#define PAGE_COUNT 256
+
+/* The number of pages of glyphs needed to cover all of Unicode */
+#define XFT_PAGE_COUNT (0x110000 / PAGE_SIZE)
+
+/* The number of colors an Xft renderer remembers */
+#define XFT_COLOR_COUNT 32
+
+/* The character drawn in place of invalid UTF-8 */
+#define REPLACEMENT_CHAR 0xFFFD
+
 
 /* The format of a guesses table entry */
 struct guess {
@@ -246,6 +279,75 @@ alloc_font_code_set(Display *display, XFontStruct *font)
     return string;
 }
 
+/* A remembered string measurement */
+struct measurement {
+    /* The length of the string, or -1 if the entry is unused */
+    long length;
+
+    /* The string itself */
+    char string[MEMO_STRING_MAX + 1];
+
+    /* Its measurements */
+    struct string_sizes sizes;
+
+    /* A reference to its encoding, or NULL if it has only been
+     * measured */
+    utf8_text_t text;
+};
+
+/* The structure of an encoded string */
+struct utf8_text {
+    /* The number of references to the encoding, which is shared by
+     * everyone who encodes the same short string */
+    unsigned int ref_count;
+
+    /* The number of characters */
+    size_t count;
+
+    /* The distance from the string's origin to the origin of each
+     * character, followed by the string's width */
+    long *offsets;
+
+    /* The characters in the font's code set, either one byte each or
+     * as XChar2b, or the glyph indices of an Xft font */
+    char *chars;
+};
+
+/* The measurements of a character with the font's defaults resolved */
+struct char_metrics {
+    /* The distance from the origin to the left edge of the character */
+    short lbearing;
+
+    /* The distance from the origin to the right edge of the character */
+    short rbearing;
+
+    /* The distance from the origin to the next character's origin */
+    short width;
+};
+
+#if defined(USE_XFT)
+/* A character's glyph in an Xft font and its measurements */
+struct xft_glyph {
+    /* Non-zero once the glyph has been looked up */
+    int is_known;
+
+    /* The glyph's index in the font */
+    FT_UInt index;
+
+    /* Its measurements */
+    struct char_metrics metrics;
+};
+
+/* A remembered Xft color */
+struct xft_color {
+    /* Non-zero if the entry is in use */
+    int is_valid;
+
+    /* The color, including its pixel value */
+    XftColor color;
+};
+#endif /* USE_XFT */
+
 /* Information used to display a UTF-8 string in a given font */
 struct utf8_renderer {
     /* The font to use */
@@ -261,11 +363,70 @@ struct utf8_renderer {
     /* The number of bytes per character in the font's code set */
     int dimension;
 
+    /* Non-zero if ASCII characters are encoded as themselves in the
+     * font's code set */
+    int is_ascii_safe;
+
     /* The thickness of an underline */
     long underline_thickness;
 
     /* The position of an underline */
     long underline_position;
+
+    /* The distance from the baseline to the top of the font */
+    short ascent;
+
+    /* The distance from the baseline to the bottom of the font */
+    short descent;
+
+    /* The smallest left bearing of any character in the font */
+    long min_lbearing;
+
+    /* The largest right bearing of any character in the font */
+    long max_rbearing;
+
+    /* Recently measured short strings, indexed by their hash */
+    struct measurement memo[MEMO_SIZE];
+
+    /* The measurements of each character, in pages indexed by the
+     * first byte of the character.  The first page is always filled
+     * in; the others are filled in when they're first needed. */
+    struct char_metrics *pages[PAGE_COUNT];
+
+    /* The first page of measurements */
+    struct char_metrics first_page[PAGE_SIZE];
+
+    /* Somewhere to put a page if there's no memory for it */
+    struct char_metrics spare_page[PAGE_SIZE];
+
+#if defined(USE_XFT)
+    /* The scalable font to draw with instead of the core font, or
+     * NULL if the core font is in use */
+    XftFont *xft_font;
+
+    /* The display, visual and colormap the Xft font is drawn with */
+    Display *display;
+    Visual *visual;
+    Colormap colormap;
+
+    /* The Xft drawing context, and the drawable and clip rectangle it
+     * was last used with */
+    XftDraw *xft_draw;
+    Drawable xft_drawable;
+    XRectangle xft_clip;
+
+    /* Recently used colors of a colormapped visual, indexed by their
+     * pixel values */
+    struct xft_color colors[XFT_COLOR_COUNT];
+
+    /* The glyph of each character, in pages indexed by the high bits
+     * of the code point.  Pages are allocated when they're first
+     * needed and glyphs are looked up when they're first drawn. */
+    struct xft_glyph **glyph_pages;
+
+    /* Somewhere to put a glyph if there's no memory for its page */
+    struct xft_glyph spare_glyph;
+#endif /* USE_XFT */
 };
 
 /* Answers the statistics to use for a given character in the font */
@@ -317,6 +478,47 @@ per_char(XFontStruct *font, unsigned char byte1, unsigned char byte2)
     return &empty_char;
 }
 
+/* Fills in a page of character measurements */
+static void
+fill_page(XFontStruct *font, unsigned char byte1, struct char_metrics *page)
+{
+    const XCharStruct *info;
+    int i;
+
+    for (i = 0; i < PAGE_SIZE; i++) {
+        info = per_char(font, byte1, i);
+        page[i].lbearing = info->lbearing;
+        page[i].rbearing = info->rbearing;
+        page[i].width = info->width;
+    }
+}
+
+/* Returns the page of measurements for characters whose first byte
+ * is byte1, filling it in if this is the first time it's needed */
+static const struct char_metrics *
+metrics_page(utf8_renderer_t self, unsigned char byte1)
+{
+    struct char_metrics *page;
+
+    /* Have we already got it? */
+    page = self->pages[byte1];
+    if (page != NULL) {
+        return page;
+    }
+
+    /* No.  Make room for it, or make do with the spare if there's
+     * no memory to be had */
+    page = malloc(PAGE_SIZE * sizeof(struct char_metrics));
+    if (page == NULL) {
+        fill_page(self->font, byte1, self->spare_page);
+        return self->spare_page;
+    }
+
+    fill_page(self->font, byte1, page);
+    self->pages[byte1] = page;
+    return page;
+}
+
 /* Returns the number of bytes required to encode a single character
  * in the output encoding */
 static int
@@ -342,6 +544,41 @@ cd_dimension(iconv_t cd)
     return point - buffer;
 }
 
+/* Answers non-zero if the conversion descriptor leaves ASCII
+ * characters as they are */
+static int
+cd_is_ascii_safe(iconv_t cd, int dimension)
+{
+    char ascii[0x7f];
+    char buffer[0x7f];
+    const char *string = ascii;
+    char *point = buffer;
+    size_t in_length = sizeof(ascii);
+    size_t out_length = sizeof(buffer);
+    int i;
+
+    /* Only one-byte code sets can be */
+    if (dimension != 1) {
+        return 0;
+    }
+
+    /* Convert every ASCII character other than NUL */
+    for (i = 0; i < (int)sizeof(ascii); i++) {
+        ascii[i] = i + 1;
+    }
+
+    if (iconv(cd, (ICONV_CONST char**)&string, &in_length,
+              &point, &out_length) == (size_t)-1 ||
+        in_length != 0 || out_length != 0) {
+        iconv(cd, NULL, NULL, NULL, NULL);
+        return 0;
+    }
+
+    /* Put the descriptor back in its initial state */
+    iconv(cd, NULL, NULL, NULL, NULL);
+    return memcmp(ascii, buffer, sizeof(ascii)) == 0;
+}
+
 /* Returns an iconv conversion descriptor for converting characters to
  * be displayed in a given font from a given code set.  If tocode is
  * non-NULL then it will be used, otherwise an attempt will be made to
@@ -354,6 +591,7 @@ utf8_renderer_alloc(Display *display, XFontStruct *font, const char *tocode)
     int dimension;
     char *string;
     unsigned long value;
+    int i;
 
     /* Allocate room for the new utf8_renderer */
     self = malloc(sizeof(struct utf8_renderer));
@@ -366,6 +604,27 @@ utf8_renderer_alloc(Display *display, XFontStruct *font, const char *tocode)
     self->cd = (iconv_t)-1;
     self->is_skipping = 0;
     self->dimension = 1;
+    self->is_ascii_safe = 1;
+    for (i = 0; i < MEMO_SIZE; i++) {
+        self->memo[i].length = -1;
+        self->memo[i].text = NULL;
+    }
+
+    self->ascent = font->ascent;
+    self->descent = font->descent;
+    self->min_lbearing = font->min_bounds.lbearing;
+    self->max_rbearing = font->max_bounds.rbearing;
+#if defined(USE_XFT)
+    self->xft_font = NULL;
+#endif /* USE_XFT */
+
+    /* Measure the first page of characters, which is all that an
+     * 8-bit font has */
+    fill_page(font, 0, self->first_page);
+    self->pages[0] = self->first_page;
+    for (i = 1; i < PAGE_COUNT; i++) {
+        self->pages[i] = NULL;
+    }
 
     /* Is there a font property for underline thickness? */
     if (!XGetFontProperty(font, XA_UNDERLINE_THICKNESS, &value)) {
@@ -404,6 +663,7 @@ utf8_renderer_alloc(Display *display, XFontStruct *font, const char *tocode)
 
         self->cd = cd;
         self->dimension = dimension;
+        self->is_ascii_safe = cd_is_ascii_safe(cd, dimension);
         return self;
     }
 
@@ -435,11 +695,155 @@ utf8_renderer_alloc(Display *display, XFontStruct *font, const char *tocode)
     /* Successful guess! */
     self->cd = cd;
     self->dimension = dimension;
+    self->is_ascii_safe = cd_is_ascii_safe(cd, dimension);
 #endif /* HAVE_ICONV */
 
     return self;
 }
 
+/* Returns a utf8_renderer which draws UTF-8 characters with the named
+ * Xft font */
+utf8_renderer_t
+utf8_renderer_alloc_xft(Display *display,
+                        Screen *screen,
+                        Colormap colormap,
+                        const char *name)
+{
+#if defined(USE_XFT)
+    utf8_renderer_t self;
+    XftFont *font;
+    int i;
+
+    /* Open the font */
+    font = XftFontOpenName(display, XScreenNumberOfScreen(screen), name);
+    if (font == NULL) {
+        fprintf(stderr, "%s: warning: unable to open font %s\n",
+                progname, name);
+        return NULL;
+    }
+
+    /* Allocate room for the new utf8_renderer */
+    self = malloc(sizeof(struct utf8_renderer));
+    if (self == NULL) {
+        XftFontClose(display, font);
+        return NULL;
+    }
+
+    /* And for its glyph pages */
+    self->glyph_pages = calloc(XFT_PAGE_COUNT, sizeof(struct xft_glyph *));
+    if (self->glyph_pages == NULL) {
+        XftFontClose(display, font);
+        free(self);
+        return NULL;
+    }
+
+    /* Xft takes care of the encoding, so there's no conversion
+     * descriptor and the characters are glyph indices */
+    self->font = NULL;
+    self->cd = (iconv_t)-1;
+    self->is_skipping = 0;
+    self->dimension = sizeof(FT_UInt);
+    self->is_ascii_safe = 0;
+    for (i = 0; i < MEMO_SIZE; i++) {
+        self->memo[i].length = -1;
+        self->memo[i].text = NULL;
+    }
+
+    for (i = 0; i < PAGE_COUNT; i++) {
+        self->pages[i] = NULL;
+    }
+
+    /* The bearings are widened as glyphs are measured */
+    self->ascent = font->ascent;
+    self->descent = font->descent;
+    self->min_lbearing = 0;
+    self->max_rbearing = 0;
+
+    /* Make up an underline as we do for core fonts without the
+     * properties */
+    self->underline_thickness = MAX((font->ascent +
+                                     font->descent + 10L) / 20, 1);
+    self->underline_position = MAX((font->descent + 4L) / 8, 1);
+
+    self->xft_font = font;
+    self->display = display;
+    self->visual = DefaultVisualOfScreen(screen);
+    self->colormap = colormap;
+    self->xft_draw = NULL;
+    self->xft_drawable = None;
+    for (i = 0; i < XFT_COLOR_COUNT; i++) {
+        self->colors[i].is_valid = 0;
+    }
+
+    return self;
+#else /* !USE_XFT */
+    fprintf(stderr, "%s: warning: unable to open font %s: "
+            "built without Xft support\n", progname, name);
+    return NULL;
+#endif /* USE_XFT */
+}
+
+/* Releases the resources allocated by a utf8_renderer_t */
+void
+utf8_renderer_free(utf8_renderer_t self)
+{
+    int i;
+
+    /* Release the encodings we remembered */
+    for (i = 0; i < MEMO_SIZE; i++) {
+        if (self->memo[i].text != NULL) {
+            utf8_text_free(self->memo[i].text);
+        }
+    }
+
+    /* Free the pages of measurements which were allocated */
+    for (i = 1; i < PAGE_COUNT; i++) {
+        if (self->pages[i] != NULL) {
+            free(self->pages[i]);
+        }
+    }
+
+#if defined(USE_XFT)
+    /* And those of glyphs */
+    if (self->xft_font != NULL) {
+        for (i = 0; i < XFT_PAGE_COUNT; i++) {
+            if (self->glyph_pages[i] != NULL) {
+                free(self->glyph_pages[i]);
+            }
+        }
+
+        free(self->glyph_pages);
+        if (self->xft_draw != NULL) {
+            XftDrawDestroy(self->xft_draw);
+        }
+
+        XftFontClose(self->display, self->xft_font);
+    }
+#endif /* USE_XFT */
+
+#ifdef HAVE_ICONV
+    if (self->cd != (iconv_t)-1) {
+        iconv_close(self->cd);
+    }
+#endif /* HAVE_ICONV */
+
+    free(self);
+}
+
+/* Answers the distance from the baseline to the top of the font */
+int
+utf8_renderer_ascent(utf8_renderer_t self)
+{
+    return self->ascent;
+}
+
+/* Answers the distance from the baseline to the bottom of the font */
+int
+utf8_renderer_descent(utf8_renderer_t self)
+{
+    return self->descent;
+}
+
 /* Wrapper around iconv() to catch most of the nasty gotchas */
 static size_t
 utf8_renderer_iconv(utf8_renderer_t self,
@@ -513,6 +917,9 @@ utf8_renderer_iconv(utf8_renderer_t self,
             case E2BIG:
                 return count;
 
+            /* An incomplete sequence at the end of the input can't
+             * be finished, so treat it as an invalid one */
+            case EINVAL:
             case EILSEQ:
                 errno = 0;
 
@@ -550,224 +957,662 @@ utf8_renderer_iconv(utf8_renderer_t self,
     return count;
 }
 
-/* Measures all of the characters in a string */
-void
-utf8_renderer_measure_string(utf8_renderer_t self,
-                             const char *string,
-                             string_sizes_t sizes)
+/* Returns the number of ASCII bytes at the start of a string.  Most
+ * strings are entirely ASCII, so check as many bytes at a time as the
+ * processor allows. */
+static size_t
+ascii_prefix(const char *string, size_t length)
+{
+    const unsigned char *point = (const unsigned char *)string;
+    const unsigned char *end = point + length;
+
+#if defined(__AVX2__)
+    /* Check 32 bytes at a time */
+    while (end - point >= 32 &&
+           _mm256_movemask_epi8(
+               _mm256_loadu_si256((const __m256i *)point)) == 0) {
+        point += 32;
+    }
+#endif /* __AVX2__ */
+
+#if defined(__SSE2__)
+    /* Check 16 bytes at a time */
+    while (end - point >= 16 &&
+           _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)point)) == 0) {
+        point += 16;
+    }
+#endif /* __SSE2__ */
+
+    /* Check the rest a byte at a time */
+    while (point < end && *point < 0x80) {
+        point++;
+    }
+
+    return point - (const unsigned char *)string;
+}
+
+/* Returns the number of non-ASCII bytes at the start of a string */
+static size_t
+non_ascii_prefix(const char *string, size_t length)
+{
+    const unsigned char *point = (const unsigned char *)string;
+    const unsigned char *end = point + length;
+
+    while (point < end && 0x80 <= *point) {
+        point++;
+    }
+
+    return point - (const unsigned char *)string;
+}
+
+#if defined(USE_XFT)
+/* Decodes the UTF-8 character at point and moves point past it.
+ * Invalid and incomplete sequences decode as the replacement
+ * character. */
+static unsigned long
+next_char(const unsigned char **point, const unsigned char *end)
+{
+    const unsigned char *p = *point;
+    unsigned long ch, min;
+    int count;
+
+    /* Work out how many continuation bytes to expect */
+    ch = *p++;
+    if (ch < 0x80) {
+        *point = p;
+        return ch;
+    } else if ((ch & 0xe0) == 0xc0) {
+        ch &= 0x1f;
+        min = 0x80;
+        count = 1;
+    } else if ((ch & 0xf0) == 0xe0) {
+        ch &= 0x0f;
+        min = 0x800;
+        count = 2;
+    } else if ((ch & 0xf8) == 0xf0) {
+        ch &= 0x07;
+        min = 0x10000;
+        count = 3;
+    } else {
+        /* Skip a stray continuation byte and any which follow it */
+        while (p < end && (*p & 0xc0) == 0x80) {
+            p++;
+        }
+
+        *point = p;
+        return REPLACEMENT_CHAR;
+    }
+
+    /* Accumulate the continuation bytes */
+    while (count-- != 0) {
+        if (p == end || (*p & 0xc0) != 0x80) {
+            *point = p;
+            return REPLACEMENT_CHAR;
+        }
+
+        ch = ch << 6 | (*p++ & 0x3f);
+    }
+
+    /* Reject overlong encodings, surrogates and anything beyond the
+     * end of Unicode */
+    *point = p;
+    if (ch < min || (0xd800 <= ch && ch <= 0xdfff) || 0x10ffff < ch) {
+        return REPLACEMENT_CHAR;
+    }
+
+    return ch;
+}
+
+/* Returns the glyph for a character in the renderer's Xft font,
+ * looking it up and measuring it if this is the first time it's been
+ * needed */
+static const struct xft_glyph *
+xft_glyph(utf8_renderer_t self, unsigned long ch)
+{
+    struct xft_glyph *page;
+    struct xft_glyph *glyph;
+    XGlyphInfo info;
+
+    /* Find the character's page, making room for it if necessary */
+    page = self->glyph_pages[ch / PAGE_SIZE];
+    if (page == NULL) {
+        page = calloc(PAGE_SIZE, sizeof(struct xft_glyph));
+        self->glyph_pages[ch / PAGE_SIZE] = page;
+    }
+
+    /* Make do with the spare if there's no memory to be had */
+    if (page == NULL) {
+        glyph = &self->spare_glyph;
+        glyph->is_known = 0;
+    } else {
+        glyph = page + ch % PAGE_SIZE;
+        if (glyph->is_known) {
+            return glyph;
+        }
+    }
+
+    /* Look up the glyph.  Missing characters get the font's default
+     * glyph, which is glyph 0. */
+    glyph->index = XftCharIndex(self->display, self->xft_font, ch);
+    XftGlyphExtents(self->display, self->xft_font, &glyph->index, 1, &info);
+    glyph->metrics.lbearing = -info.x;
+    glyph->metrics.rbearing = info.width - info.x;
+    glyph->metrics.width = info.xOff;
+    glyph->is_known = 1;
+
+    /* Widen the font's bearings to cover it */
+    self->min_lbearing = MIN(self->min_lbearing,
+                             (long)glyph->metrics.lbearing);
+    self->max_rbearing = MAX(self->max_rbearing,
+                             (long)glyph->metrics.rbearing);
+    return glyph;
+}
+
+/* Looks up the glyphs of a string in the renderer's Xft font and
+ * measures it.  If text isn't NULL then the glyphs and their offsets
+ * are recorded in it as well. */
+static void
+xft_encode_string(utf8_renderer_t self,
+                  const char *string,
+                  string_sizes_t sizes,
+                  utf8_text_t text)
+{
+    const unsigned char *point = (const unsigned char *)string;
+    const unsigned char *end = point + strlen(string);
+    const struct xft_glyph *glyph;
+    FT_UInt *glyphs = NULL;
+    long lbearing = 0;
+    long rbearing = 0;
+    long width = 0;
+    int is_first;
+
+    if (text != NULL) {
+        glyphs = (FT_UInt *)text->chars;
+    }
+
+    /* Measure each character, recording where each one starts */
+    is_first = True;
+    while (point < end) {
+        glyph = xft_glyph(self, next_char(&point, end));
+        if (is_first) {
+            is_first = False;
+            lbearing = glyph->metrics.lbearing;
+            rbearing = glyph->metrics.rbearing;
+        } else {
+            lbearing = MIN(lbearing, width + (long)glyph->metrics.lbearing);
+            rbearing = MAX(rbearing, width + (long)glyph->metrics.rbearing);
+        }
+
+        if (text != NULL) {
+            glyphs[text->count] = glyph->index;
+            text->offsets[text->count++] = width;
+        }
+
+        width += (long)glyph->metrics.width;
+    }
+
+    /* The last offset is the end of the string */
+    if (text != NULL) {
+        text->offsets[text->count] = width;
+    }
+
+    /* Record our findings */
+    sizes->lbearing = lbearing;
+    sizes->rbearing = rbearing;
+    sizes->width = width;
+    sizes->ascent = self->ascent;
+    sizes->descent =
+        MAX(self->descent,
+            self->underline_position + self->underline_thickness);
+}
+
+/* Scales the component of a pixel selected by a visual's color mask
+ * to 16 bits */
+static unsigned short
+mask_component(unsigned long pixel, unsigned long mask)
+{
+    if (mask == 0) {
+        return 0;
+    }
+
+    /* Shift the component down to the bottom bits */
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        pixel >>= 1;
+    }
+
+    return (unsigned short)((pixel & mask) * 0xffffUL / mask);
+}
+
+/* Answers the Xft color for a pixel value.  For colormapped visuals
+ * the X server is asked for its components if it hasn't been used
+ * recently. */
+static void
+xft_color(utf8_renderer_t self, unsigned long pixel, XftColor *color_out)
+{
+    struct xft_color *entry;
+    XColor color;
+
+    /* The components of a TrueColor or DirectColor pixel are right
+     * there in its bits */
+    if (self->visual->class == TrueColor ||
+        self->visual->class == DirectColor) {
+        color_out->pixel = pixel;
+        color_out->color.red = mask_component(pixel, self->visual->red_mask);
+        color_out->color.green =
+            mask_component(pixel, self->visual->green_mask);
+        color_out->color.blue =
+            mask_component(pixel, self->visual->blue_mask);
+        color_out->color.alpha = 0xffff;
+        return;
+    }
+
+    /* Otherwise, have we seen it recently? */
+    entry = &self->colors[pixel % XFT_COLOR_COUNT];
+    if (entry->is_valid && entry->color.pixel == pixel) {
+        *color_out = entry->color;
+        return;
+    }
+
+    /* No.  Look it up. */
+    color.pixel = pixel;
+    XQueryColor(self->display, self->colormap, &color);
+    entry->color.pixel = pixel;
+    entry->color.color.red = color.red;
+    entry->color.color.green = color.green;
+    entry->color.color.blue = color.blue;
+    entry->color.color.alpha = 0xffff;
+    entry->is_valid = 1;
+    *color_out = entry->color;
+}
+
+/* Draws glyphs in the renderer's Xft font in the GC's foreground
+ * color, clipped to the bounding box */
+static void
+xft_draw_glyphs(Display *display,
+                Drawable drawable,
+                GC gc,
+                utf8_renderer_t self,
+                int x,
+                int y,
+                XRectangle *bbox,
+                const FT_UInt *glyphs,
+                int count)
+{
+    XGCValues values;
+    XftColor color;
+
+    /* Point the drawing context at the drawable */
+    if (self->xft_draw == NULL) {
+        self->xft_draw = XftDrawCreate(display, drawable, self->visual,
+                                       self->colormap);
+        if (self->xft_draw == NULL) {
+            return;
+        }
+
+        self->xft_drawable = drawable;
+        self->xft_clip.x = 0;
+        self->xft_clip.y = 0;
+        self->xft_clip.width = 0;
+        self->xft_clip.height = 0;
+    } else if (self->xft_drawable != drawable) {
+        XftDrawChange(self->xft_draw, drawable);
+        self->xft_drawable = drawable;
+    }
+
+    /* Xft ignores the GC's clip mask, so clip to the bounding box
+     * instead, but only tell the server when it changes */
+    if (self->xft_clip.x != bbox->x || self->xft_clip.y != bbox->y ||
+        self->xft_clip.width != bbox->width ||
+        self->xft_clip.height != bbox->height) {
+        XftDrawSetClipRectangles(self->xft_draw, 0, 0, bbox, 1);
+        self->xft_clip = *bbox;
+    }
+
+    /* Draw in the GC's foreground color */
+    XGetGCValues(display, gc, GCForeground, &values);
+    xft_color(self, values.foreground, &color);
+    XftDrawGlyphs(self->xft_draw, &color, self->xft_font, x, y, glyphs, count);
+}
+#endif /* USE_XFT */
+
+/* Converts a string into the font's code set and measures it.  If
+ * text isn't NULL then the converted characters and their offsets are
+ * recorded in it as well. */
+static void
+encode_string(utf8_renderer_t self,
+              const char *string,
+              string_sizes_t sizes,
+              utf8_text_t text)
 {
     char buffer[BUFFER_SIZE];
-    const XCharStruct *info;
+    const struct char_metrics *info;
+    const char *chars;
     long lbearing = 0;
     long rbearing = 0;
     long width = 0;
     char *out_point;
     size_t in_length;
     size_t out_length;
+    size_t run, left;
+    size_t count, i;
     int is_first;
 
+#if defined(USE_XFT)
+    /* Xft fonts don't need converting */
+    if (self->xft_font != NULL) {
+        xft_encode_string(self, string, sizes, text);
+        return;
+    }
+#endif /* USE_XFT */
+
+    /* Don't skip the start of this string because the last one ended
+     * partway through a character */
+    self->is_skipping = 0;
+
     /* Count the number of bytes in the string */
     in_length = strlen(string);
 
     /* Keep going until we get the whole string */
     is_first = True;
     while (in_length != 0) {
-        /* Convert the string into the display code set */
-        out_length = BUFFER_SIZE;
-        out_point = buffer;
-        if (utf8_renderer_iconv(self, &string, &in_length,
-                                &out_point, &out_length) == (size_t)-1 &&
-            errno != E2BIG) {
-            /* This shouldn't fail */
-            abort();
+        /* ASCII characters are their own encoding in many fonts, so
+         * runs of them can skip the conversion altogether */
+        run = self->is_ascii_safe ? ascii_prefix(string, in_length) : 0;
+        if (run != 0) {
+            /* An ASCII character ends any untranslatable sequence */
+            self->is_skipping = 0;
+            chars = string;
+            count = run;
+            string += run;
+            in_length -= run;
+        } else {
+            /* Otherwise convert up to the next run of ASCII */
+            run = in_length;
+            if (self->is_ascii_safe) {
+                run = non_ascii_prefix(string, in_length);
+            }
+
+            out_length = BUFFER_SIZE;
+            out_point = buffer;
+            left = run;
+            if (utf8_renderer_iconv(self, &string, &left,
+                                    &out_point, &out_length) == (size_t)-1 &&
+                errno != E2BIG) {
+                /* This shouldn't fail */
+                abort();
+            }
+
+            in_length -= run - left;
+            chars = buffer;
+            count = (out_point - buffer) / self->dimension;
         }
 
-        /* Measure the characters */
-        if (self->dimension == 1) {
-            char *point = buffer;
-
-            /* Set the initial measurements */
-            if (is_first) {
-                is_first = False;
-                info = per_char(self->font, 0, *(unsigned char *)point);
-                lbearing = info->lbearing;
-                rbearing = info->rbearing;
-                width = info->width;
-                point++;
+        /* Keep the characters if asked to */
+        if (text != NULL) {
+            memcpy(text->chars + text->count * self->dimension, chars,
+                   count * self->dimension);
+        }
+
+        /* The string's bearings start out as those of its first
+         * character */
+        if (is_first && count != 0) {
+            is_first = False;
+            if (self->dimension == 1) {
+                info = self->first_page + *(const unsigned char *)chars;
+            } else {
+                info = metrics_page(self, ((const XChar2b *)chars)->byte1) +
+                    ((const XChar2b *)chars)->byte2;
             }
 
-            /* Adjust for the rest of the string */
-            while (point < out_point) {
-                info = per_char(self->font, 0, *(unsigned char *)point);
+            lbearing = info->lbearing;
+            rbearing = info->rbearing;
+        }
+
+        /* Measure the characters, recording where each one starts */
+        if (self->dimension == 1) {
+            const unsigned char *point = (const unsigned char *)chars;
+
+            for (i = 0; i < count; i++) {
+                info = self->first_page + point[i];
                 lbearing = MIN(lbearing, width + (long)info->lbearing);
                 rbearing = MAX(rbearing, width + (long)info->rbearing);
+                if (text != NULL) {
+                    text->offsets[text->count++] = width;
+                }
                 width += (long)info->width;
-                point++;
             }
         } else {
-            XChar2b *point = (XChar2b *)buffer;
-
-            /* Set the initial measurements */
-            if (is_first) {
-                is_first = False;
-                info = per_char(self->font, point->byte1, point->byte2);
-                lbearing = info->lbearing;
-                rbearing = info->rbearing;
-                width = info->width;
-                point++;
-            }
+            const XChar2b *point = (const XChar2b *)chars;
 
-            /* Adjust for the rest of the string */
-            while (point < (XChar2b *)out_point) {
-                info = per_char(self->font, point->byte1, point->byte2);
+            for (i = 0; i < count; i++) {
+                info = metrics_page(self, point[i].byte1) + point[i].byte2;
                 lbearing = MIN(lbearing, width + (long)info->lbearing);
                 rbearing = MAX(rbearing, width + (long)info->rbearing);
+                if (text != NULL) {
+                    text->offsets[text->count++] = width;
+                }
                 width += (long)info->width;
-                point++;
             }
         }
     }
 
+    /* The last offset is the end of the string */
+    if (text != NULL) {
+        text->offsets[text->count] = width;
+    }
+
     /* Record our findings */
     sizes->lbearing = lbearing;
     sizes->rbearing = rbearing;
     sizes->width = width;
-    sizes->ascent = self->font->ascent;
+    sizes->ascent = self->ascent;
     sizes->descent =
-        MAX(self->font->descent,
+        MAX(self->descent,
             self->underline_position + self->underline_thickness);
 }
 
-/* Draw a string within the bounding box, measuring the characters so
- * as to minimize bandwidth requirements */
+/* Returns the memo entry in which a string would be remembered, or
+ * NULL if it's too long to remember, and sets length_out to its
+ * length */
+static struct measurement *
+memo_find(utf8_renderer_t self, const char *string, long *length_out)
+{
+    const unsigned char *point = (const unsigned char *)string;
+    unsigned long hash = 5381;
+
+    /* Hash the string if it's short enough to remember */
+    while (*point != '\0' && point - (const unsigned char *)string <=
+           MEMO_STRING_MAX) {
+        hash = hash * 33 + *point++;
+    }
+
+    *length_out = (long)(point - (const unsigned char *)string);
+    if (*length_out > MEMO_STRING_MAX) {
+        return NULL;
+    }
+
+    return self->memo + hash % MEMO_SIZE;
+}
+
+/* Answers non-zero if entry remembers the given string */
+static int
+memo_matches(struct measurement *entry, const char *string, long length)
+{
+    return entry->length == length &&
+        memcmp(entry->string, string, length) == 0;
+}
+
+/* Remembers a string's measurements and encoding in entry, replacing
+ * whatever it held before.  The entry takes over the caller's
+ * reference to text. */
+static void
+memo_remember(struct measurement *entry,
+              const char *string,
+              long length,
+              string_sizes_t sizes,
+              utf8_text_t text)
+{
+    if (entry->text != NULL) {
+        utf8_text_free(entry->text);
+    }
+
+    memcpy(entry->string, string, length);
+    entry->length = length;
+    entry->sizes = *sizes;
+    entry->text = text;
+}
+
+/* Measures all of the characters in a string, remembering the
+ * measurements of short strings since the same separators,
+ * timestamps, groups and users are measured over and over */
 void
-utf8_renderer_draw_string(Display *display,
-                          Drawable drawable,
-                          GC gc,
-                          utf8_renderer_t renderer,
-                          int x,
-                          int y,
-                          XRectangle *bbox,
-                          const char *string)
+utf8_renderer_measure_string(utf8_renderer_t self,
+                             const char *string,
+                             string_sizes_t sizes)
 {
-    char buffer[BUFFER_SIZE];
-    const XCharStruct *info;
-    long left, right;
-    char *out_point;
-    size_t in_length;
-    size_t out_length;
+    struct measurement *entry;
+    long length;
+
+    /* Measure it directly if it's too long to remember */
+    entry = memo_find(self, string, &length);
+    if (entry == NULL) {
+        encode_string(self, string, sizes, NULL);
+        return;
+    }
 
-    /* Count the number of bytes in the string */
-    in_length = strlen(string);
+    /* Have we measured it recently? */
+    if (memo_matches(entry, string, length)) {
+        *sizes = entry->sizes;
+        return;
+    }
 
-    /* Skip over characters outside the bounding box */
-    left = x;
-    while (in_length != 0) {
-        /* Convert the string into the font's code set */
-        out_length = BUFFER_SIZE;
-        out_point = buffer;
-        if (utf8_renderer_iconv(renderer, &string, &in_length,
-                                &out_point, &out_length) == (size_t)-1 &&
-            errno != E2BIG) {
-            /* This shouldn't fail */
-            abort();
-        }
+    /* No.  Measure it and remember the result */
+    encode_string(self, string, sizes, NULL);
+    memo_remember(entry, string, length, sizes, NULL);
+}
 
-        /* Are characters in this code set one byte wide? */
-        if (renderer->dimension == 1) {
-            const char *first;
-            const char *last;
-
-            /* Look for visible characters in the buffer */
-            first = buffer;
-            while (first < out_point) {
-                info = per_char(renderer->font, 0,
-                                *(const unsigned char*)first);
-
-                /* Skip anything to the left of the bounding box */
-                if (left + info->rbearing < bbox->x) {
-                    left = left + (long)info->width;
-                    first++;
-                } else {
-                    /* Look for the last visible character */
-                    last = first;
-                    right = left;
-                    while (last < out_point) {
-                        info = per_char(renderer->font, 0,
-					*(const unsigned char*)last);
-
-                        if (right + info->lbearing < bbox->x + bbox->width) {
-                            right = right + (long)info->width;
-                            last++;
-                        } else {
-                            /* Reset the conversion descriptor */
-                            if (utf8_renderer_iconv(
-                                    renderer,
-                                    NULL, NULL,
-                                    NULL, NULL) == (size_t)-1) {
-                                abort();
-                            }
-
-                            XDrawString(display, drawable, gc, left, y,
-                                        first, last - first);
-                            return;
-                        }
-                    }
-
-                    /* Still visible at the end of the buffer */
-                    XDrawString(display, drawable, gc, left, y,
-                                first, last - first);
-                    first = last;
-                    left = right;
-                }
-            }
-        } else {
-            XChar2b *first;
-            XChar2b *last;
+/* Encodes a string in the renderer's font and measures it.  Short
+ * strings share the encoding remembered with their measurements,
+ * since every view encodes the same separator and most of them the
+ * same timestamps, groups and users. */
+utf8_text_t
+utf8_renderer_encode(utf8_renderer_t self,
+                     const char *string,
+                     string_sizes_t sizes)
+{
+    struct measurement *entry;
+    utf8_text_t text;
+    long length;
+
+    /* Share the encoding if we've made it recently */
+    entry = memo_find(self, string, &length);
+    if (entry != NULL && entry->text != NULL &&
+        memo_matches(entry, string, length)) {
+        entry->text->ref_count++;
+        *sizes = entry->sizes;
+        return entry->text;
+    }
 
-            /* Look for visible characters in the buffer */
-            first = (XChar2b *)buffer;
-            while (first < (XChar2b *)out_point) {
-                info = per_char(renderer->font, first->byte1, first->byte2);
+    /* Every character takes at least one byte of UTF-8, so there
+     * can't be more characters than that */
+    length = (long)strlen(string);
+    text = malloc(sizeof(struct utf8_text) +
+                  (length + 1) * sizeof(long) +
+                  length * self->dimension);
+    if (text == NULL) {
+        return NULL;
+    }
 
-                if (left + info->rbearing < bbox->x) {
-                    left = left + (long)info->width;
-                    first++;
-                } else {
-                    /* Look for the last visible character */
-                    last = first;
-                    right = left;
-                    while (last < (XChar2b *)out_point) {
-                        info = per_char(renderer->font, last->byte1,
-                                        last->byte2);
-
-                        if (right + info->lbearing < bbox->x + bbox->width) {
-                            right = right + (long)info->width;
-                            last++;
-                        } else {
-                            /* Reset the conversion descriptor */
-                            if (utf8_renderer_iconv(
-                                    renderer,
-                                    NULL, NULL,
-                                    NULL, NULL) == (size_t)-1) {
-                                abort();
-                            }
-
-                            XDrawString16(display, drawable, gc, left, y,
-                                          first, last - first);
-                            return;
-                        }
-                    }
-
-                    /* Still visible at the end of the buffer */
-                    XDrawString16(display, drawable, gc, left, y,
-                                  first, last - first);
-                    first = last;
-                    left = right;
-                }
-            }
+    text->ref_count = 1;
+    text->count = 0;
+    text->offsets = (long *)(text + 1);
+    text->chars = (char *)(text->offsets + length + 1);
+    encode_string(self, string, sizes, text);
+
+    /* Remember short strings with a reference of our own */
+    if (entry != NULL) {
+        text->ref_count++;
+        memo_remember(entry, string, length, sizes, text);
+    }
+
+    return text;
+}
+
+/* Releases a reference to an encoded string */
+void
+utf8_text_free(utf8_text_t self)
+{
+    self->ref_count--;
+    if (self->ref_count == 0) {
+        free(self);
+    }
+}
+
+/* Returns the index of the first character of text whose offset is
+ * at least offset, or the number of characters if there is none */
+static size_t
+text_search(utf8_text_t text, long offset)
+{
+    size_t low = 0;
+    size_t high = text->count;
+    size_t middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (text->offsets[middle] < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
         }
     }
+
+    return low;
+}
+
+/* Draws the characters of an encoded string which fall within the
+ * bounding box */
+void
+utf8_renderer_draw_text(Display *display,
+                        Drawable drawable,
+                        GC gc,
+                        utf8_renderer_t renderer,
+                        int x,
+                        int y,
+                        XRectangle *bbox,
+                        utf8_text_t text)
+{
+    size_t first, last;
+
+    /* Skip characters which can't reach the left edge of the bounding
+     * box, even with the font's largest right bearing */
+    first = text_search(text, (long)bbox->x - x - renderer->max_rbearing);
+
+    /* And those which start past its right edge, even with the
+     * smallest left bearing */
+    last = text_search(text, (long)bbox->x + (long)bbox->width - x -
+                       renderer->min_lbearing);
+    if (last <= first) {
+        return;
+    }
+
+    /* Draw the rest in one go */
+#if defined(USE_XFT)
+    if (renderer->xft_font != NULL) {
+        xft_draw_glyphs(display, drawable, gc, renderer,
+                        x + text->offsets[first], y, bbox,
+                        (FT_UInt *)text->chars + first, last - first);
+        return;
+    }
+#endif /* USE_XFT */
+
+    if (renderer->dimension == 1) {
+        XDrawString(display, drawable, gc, x + text->offsets[first], y,
+                    text->chars + first, last - first);
+    } else {
+        XDrawString16(display, drawable, gc, x + text->offsets[first], y,
+                      (XChar2b *)text->chars + first, last - first);
+    }
 }
 
 /* Underline a string within the bounding box, measuring the
@@ -803,8 +1648,23 @@ struct utf8_encoder {
 
     /* The conversion descriptor for decoding (UTF-8 to xxx) */
     iconv_t decoder_cd;
+
+    /* Non-zero if the descriptors leave ASCII characters as they are */
+    int is_encoder_ascii_safe;
+    int is_decoder_ascii_safe;
 };
 
+/* Works out whether the encoder's conversion descriptors leave ASCII
+ * characters as they are */
+static void
+encoder_probe_ascii(utf8_encoder_t self)
+{
+    self->is_encoder_ascii_safe = self->encoder_cd != (iconv_t)-1 &&
+        cd_is_ascii_safe(self->encoder_cd, 1);
+    self->is_decoder_ascii_safe = self->decoder_cd != (iconv_t)-1 &&
+        cd_is_ascii_safe(self->decoder_cd, 1);
+}
+
 /* Allocate and initialize a utf8_encoder */
 utf8_encoder_t
 utf8_encoder_alloc(Display *display, XmFontList font_list,
@@ -825,11 +1685,14 @@ utf8_encoder_alloc(Display *display, XmFontList font_list,
     /* Initialize with a sane value */
     self->encoder_cd = (iconv_t)-1;
     self->decoder_cd = (iconv_t)-1;
+    self->is_encoder_ascii_safe = 0;
+    self->is_decoder_ascii_safe = 0;
 
     /* If a code set was provided then use it */
     if (code_set != NULL) {
         self->encoder_cd = do_iconv_open(UTF8_CODE, code_set);
         self->decoder_cd = do_iconv_open(code_set, UTF8_CODE);
+        encoder_probe_ascii(self);
         return self;
     }
 
@@ -863,188 +1726,227 @@ utf8_encoder_alloc(Display *display, XmFontList font_list,
         /* Open the reverse conversion descriptor */
         self->decoder_cd = do_iconv_open(string, UTF8_CODE);
         free(string);
+        encoder_probe_ascii(self);
 
         XmFontListFreeFontContext(context);
         return self;
     }
 }
 
-/* Encodes a string */
-char *
-utf8_encoder_encode(utf8_encoder_t self, const char *input)
+/* Converts a string with a conversion descriptor, copying runs of
+ * ASCII straight through if the descriptor leaves them alone.  As
+ * much of the output as fits is written to buffer, and the rest is
+ * only counted.  Answers the length of the whole output, or
+ * (size_t)-1 if the input can't be converted. */
+static size_t
+convert_into(iconv_t cd,
+             int is_ascii_safe,
+             const char *input,
+             size_t in_length,
+             char *buffer,
+             size_t length)
 {
-    char *buffer;
-    char *output;
-    size_t in_length;
-    size_t out_length;
-    size_t length;
+    char scratch[BUFFER_SIZE];
+    char *point, *start;
+    size_t total = 0;
+    size_t run, left, room;
+    int is_full;
 
-    /* Measure the input string */
-    in_length = strlen(input) + 1;
+    /* Start from the descriptor's initial state */
+    iconv(cd, NULL, NULL, NULL, NULL);
 
-    /* Special case for empty strings */
-    if (in_length == 1) {
-        return strdup("");
-    }
-
-    /* If we have no encoder then do a manual ASCII to UTF-8 and
-     * replace any characters with the high bit set with a `?' */
-    if (self->encoder_cd == (iconv_t)-1) {
-        int i;
+    is_full = length == 0;
+    while (in_length != 0) {
+        /* Copy a run of ASCII */
+        run = is_ascii_safe ? ascii_prefix(input, in_length) : 0;
+        if (run != 0) {
+            if (!is_full) {
+                memcpy(buffer, input, MIN(run, length));
+                buffer += MIN(run, length);
+                length -= MIN(run, length);
+                is_full = length == 0;
+            }
 
-        /* The output will be the same size as the input */
-        output = malloc(in_length);
-        if (output == NULL) {
-            perror("malloc() failed");
-            return NULL;
+            input += run;
+            in_length -= run;
+            total += run;
+            continue;
         }
 
-        /* Copy, replacing any UTF-8 unfriendly characters */
-        for (i = 0; i < in_length; i++) {
-            int ch = input[i];
-
-            if (ch & 0x80) {
-                output[i] = '?';
+        /* Otherwise convert up to the next one, into the buffer while
+         * there's room and into the scratch space once there isn't */
+        left = is_ascii_safe ? non_ascii_prefix(input, in_length) : in_length;
+        in_length -= left;
+        while (left != 0) {
+            if (is_full) {
+                point = scratch;
+                room = sizeof(scratch);
             } else {
-                output[i] = ch;
+                point = buffer;
+                room = length;
             }
-        }
 
-        return output;
-    }
+            start = point;
+            if (iconv(cd, (ICONV_CONST char **)&input, &left,
+                      &point, &room) == (size_t)-1) {
+                if (errno != E2BIG) {
+                    return (size_t)-1;
+                }
 
-    /* Guess twice as much should suffice for the output */
-    length = 2 * in_length;
-    buffer = malloc(length);
-    if (buffer == NULL) {
-        perror("malloc() failed");
-        return NULL;
+                /* The buffer can't take the next character */
+                if (!is_full) {
+                    is_full = 1;
+                    length = room;
+                }
+            }
+
+            total += point - start;
+            if (start == buffer) {
+                buffer = point;
+                length = room;
+            }
+        }
     }
 
-    output = buffer;
-    out_length = length;
+    return total;
+}
 
-    /* Otherwise encode away! */
-    while (in_length != 0) {
-        if (iconv(self->encoder_cd,
-                  (ICONV_CONST char**)&input, &in_length,
-                  &output, &out_length) == (size_t)-1) {
-            /* If we're out of space then allocate some more */
-            if (errno == E2BIG) {
-                char *new_buffer;
-                size_t new_length;
-
-                new_length = length * 2;
-                new_buffer = realloc(buffer, new_length);
-                if (new_buffer == NULL) {
-                    perror("realloc() failed");
-                    free(output);
-                    return NULL;
-                }
+/* Encodes a string into a caller-supplied buffer */
+size_t
+utf8_encoder_encode_into(utf8_encoder_t self,
+                         const char *input,
+                         char *buffer,
+                         size_t length)
+{
+    size_t in_length;
+    size_t i;
 
-                out_length += new_length - length;
-                output = new_buffer + (output - buffer);
+    /* Include the terminating NUL */
+    in_length = strlen(input) + 1;
 
-                buffer = new_buffer;
-                length = new_length;
-            } else {
-                perror("iconv() failed");
-                return NULL;
-            }
+    /* Special case for empty strings */
+    if (in_length == 1) {
+        if (length != 0) {
+            *buffer = '\0';
         }
+
+        return 1;
+    }
+
+    /* If we have an encoder then encode away */
+    if (self->encoder_cd != (iconv_t)-1) {
+        return convert_into(self->encoder_cd, self->is_encoder_ascii_safe,
+                            input, in_length, buffer, length);
+    }
+
+    /* Otherwise do a manual ASCII to UTF-8 and replace any characters
+     * with the high bit set with a `?'.  The output will be the same
+     * size as the input. */
+    for (i = 0; i < in_length && i < length; i++) {
+        buffer[i] = (input[i] & 0x80) ? '?' : input[i];
     }
 
-    return buffer;
+    return in_length;
 }
 
-/* Decodes a string */
-char *
-utf8_encoder_decode(utf8_encoder_t self, const char *input)
+/* Decodes a string into a caller-supplied buffer */
+size_t
+utf8_encoder_decode_into(utf8_encoder_t self,
+                         const char *input,
+                         char *buffer,
+                         size_t length)
 {
-    char *buffer;
-    char *output;
     size_t in_length;
-    size_t out_length;
-    size_t length;
+    size_t i;
+    int ch;
 
-    /* Measure the input string */
+    /* Include the terminating NUL */
     in_length = strlen(input) + 1;
 
     /* Special case for empty strings */
     if (in_length == 1) {
-        return strdup("");
+        if (length != 0) {
+            *buffer = '\0';
+        }
+
+        return 1;
     }
 
-    /* If we have no decoder then do a manual UTF-8 to ASCII and
-     * replace any characters with the high bit set with `?' */
-    if (self->decoder_cd == (iconv_t)-1) {
-        int ch;
-        int i;
+    /* If we have a decoder then decode away */
+    if (self->decoder_cd != (iconv_t)-1) {
+        return convert_into(self->decoder_cd, self->is_decoder_ascii_safe,
+                            input, in_length, buffer, length);
+    }
 
-        /* The output will be no longer than the input */
-        output = malloc(in_length);
-        if (output == NULL) {
-            perror("malloc() failed");
-            return NULL;
+    /* Otherwise do a manual UTF-8 to ASCII and replace any characters
+     * with the high bit set with `?' */
+    i = 0;
+    do {
+        ch = *input++;
+        if ((ch & 0xc0) == 0xc0) {
+            ch = '?';
+        } else if ((ch & 0xc0) == 0x80) {
+            continue;
         }
 
-        /* Copy, replacing any non-ASCII characters */
-        i = 0;
-        while ((ch = *input++) != 0) {
-            if ((ch & 0xc0) == 0xc0) {
-                output[i++] = '?';
-            } else if ((ch & 0xc0) != 0x80) {
-                output[i++] = ch;
-            }
+        if (i < length) {
+            buffer[i] = ch;
         }
 
-        /* Null-terminate the output string */
-        output[i] = 0;
-        return output;
+        i++;
+    } while (ch != 0);
+
+    return i;
+}
+
+/* Converts a string into memory allocated to fit it exactly */
+static char *
+alloc_converted(utf8_encoder_t self,
+                const char *input,
+                size_t (*convert)(utf8_encoder_t self,
+                                  const char *input,
+                                  char *buffer,
+                                  size_t length))
+{
+    char buffer[BUFFER_SIZE];
+    char *result;
+    size_t length;
+
+    /* Most strings will fit on the stack */
+    length = convert(self, input, buffer, sizeof(buffer));
+    if (length == (size_t)-1) {
+        perror("iconv() failed");
+        return NULL;
     }
 
-    /* Guess the length of the UTF-8 string */
-    length = in_length;
-    buffer = malloc(length);
-    if (buffer == NULL) {
+    result = malloc(length);
+    if (result == NULL) {
         perror("malloc() failed");
         return NULL;
     }
 
-    output = buffer;
-    out_length = length;
-
-    /* Encode away */
-    while (in_length != 0) {
-        if (iconv(self->decoder_cd,
-                  (ICONV_CONST char**)&input, &in_length,
-                  &output, &out_length) == (size_t)-1) {
-            /* If we're out of space then allocate some more */
-            if (errno == E2BIG) {
-                char *new_buffer;
-                size_t new_length;
-
-                new_length = length * 2;
-                new_buffer = realloc(buffer, new_length);
-                if (new_buffer == NULL) {
-                    perror("realloc() failed");
-                    free(output);
-                    return NULL;
-                }
+    /* Copy it if it did, or convert it again straight into place */
+    if (length <= sizeof(buffer)) {
+        memcpy(result, buffer, length);
+    } else {
+        convert(self, input, result, length);
+    }
 
-                out_length += new_length - length;
-                output = new_buffer + (output - buffer);
+    return result;
+}
 
-                buffer = new_buffer;
-                length = new_length;
-            } else {
-                perror("iconv() failed");
-                return NULL;
-            }
-        }
-    }
+/* Encodes a string */
+char *
+utf8_encoder_encode(utf8_encoder_t self, const char *input)
+{
+    return alloc_converted(self, input, utf8_encoder_encode_into);
+}
 
-    return buffer;
+/* Decodes a string */
+char *
+utf8_encoder_decode(utf8_encoder_t self, const char *input)
+{
+    return alloc_converted(self, input, utf8_encoder_decode_into);
 }
 
 char *
@@ -78,11 +78,31 @@ utf8_renderer_t
 utf8_renderer_alloc(Display *display, XFontStruct *font, const char *code_set);
 
 
+/* Returns a utf8_renderer which draws UTF-8 characters with the named
+ * Xft font on drawables of the screen's default visual.  Returns NULL
+ * if the font can't be opened or Xft support wasn't compiled in. */
+utf8_renderer_t
+utf8_renderer_alloc_xft(Display *display,
+                        Screen *screen,
+                        Colormap colormap,
+                        const char *name);
+
+
 /* Releases the resources allocated by a utf8_renderer_t */
 void
 utf8_renderer_free(utf8_renderer_t self);
 
 
+/* Answers the distance from the baseline to the top of the font */
+int
+utf8_renderer_ascent(utf8_renderer_t self);
+
+
+/* Answers the distance from the baseline to the bottom of the font */
+int
+utf8_renderer_descent(utf8_renderer_t self);
+
+
 /* Measures all of the characters in a string */
 void
 utf8_renderer_measure_string(utf8_renderer_t self,
@@ -90,17 +110,37 @@ utf8_renderer_measure_string(utf8_renderer_t self,
                              string_sizes_t sizes);
 
 
-/* Draw a string within the bounding box, measuring the characters so
- * as to minimize bandwidth requirements */
+/* A string encoded in a renderer's font along with the position of
+ * each of its characters, so that it can be drawn again and again
+ * without converting it */
+typedef struct utf8_text *utf8_text_t;
+
+/* Encodes a string in the renderer's font and measures it.  Short
+ * strings may share their encoding with earlier callers, so release
+ * it with utf8_text_free() rather than modifying it.  Returns NULL if
+ * memory couldn't be allocated. */
+utf8_text_t
+utf8_renderer_encode(utf8_renderer_t self,
+                     const char *string,
+                     string_sizes_t sizes);
+
+
+/* Releases a reference to an encoded string */
 void
-utf8_renderer_draw_string(Display *display,
-                          Drawable drawable,
-                          GC gc,
-                          utf8_renderer_t renderer,
-                          int x,
-                          int y,
-                          XRectangle *bbox,
-                          const char *string);
+utf8_text_free(utf8_text_t self);
+
+
+/* Draws the characters of an encoded string which fall within the
+ * bounding box */
+void
+utf8_renderer_draw_text(Display *display,
+                        Drawable drawable,
+                        GC gc,
+                        utf8_renderer_t renderer,
+                        int x,
+                        int y,
+                        XRectangle *bbox,
+                        utf8_text_t text);
 
 
 /* Draw an underline under a string */
@@ -138,6 +178,27 @@ char *
 utf8_encoder_decode(utf8_encoder_t self, const char *input);
 
 
+/* Encodes a string into a buffer with room for length bytes.  Returns
+ * the number of bytes needed for the whole string, including its
+ * terminating NUL; if that's more than length then the buffer holds
+ * only part of the string.  Returns (size_t)-1 if the string can't
+ * be encoded. */
+size_t
+utf8_encoder_encode_into(utf8_encoder_t self,
+                         const char *input,
+                         char *buffer,
+                         size_t length);
+
+
+/* Decodes a string into a buffer with room for length bytes, returning
+ * the same as utf8_encoder_encode_into() */
+size_t
+utf8_encoder_decode_into(utf8_encoder_t self,
+                         const char *input,
+                         char *buffer,
+                         size_t length);
+
+
 /* Convert a UTF-8 string into the ICCCM target format specified by
  * target.  Supported targets are: UTF8_STRING.  Returns the converted
  * string as a block of memory allocated with XtMalloc, or NULL if